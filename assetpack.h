@@ -0,0 +1,186 @@
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+// ============================= ASSET PACK ============================= //
+// One file holding every asset already decoded: sprites as RGBA32 pixels, sound effects as PCM
+// in the mixer's output format, and fonts and music as their original bytes. A header and an
+// entry table come first; every payload starts on a PACK_ALIGNMENT boundary so images and
+// sounds can be used in place straight from the memory-mapped file. Written by packer.cpp.
+#include <cstdint>
+#include <cstring>
+#include <string>
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define PACK_MAGIC 0x4B504354 // "TCPK"
+#define PACK_VERSION 1
+#define PACK_ALIGNMENT 64
+#define PACK_NAME_LENGTH 56
+
+// The mixer is opened with this format, so packed sounds can be played without converting.
+#define PACK_AUDIO_FREQUENCY 44100
+#define PACK_AUDIO_CHANNELS 2
+
+enum PackEntryType
+{
+    PACK_IMAGE, // RGBA32 pixels; info = width, height, pitch
+    PACK_SOUND, // PCM; info = frequency, SDL audio format, channels
+    PACK_BLOB   // the file as it was (fonts, music)
+};
+
+struct PackHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t reserved;
+};
+
+// Names are the paths the game would otherwise load, e.g. "assets/car-red.png".
+struct PackEntry
+{
+    char name[PACK_NAME_LENGTH];
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t info[4];
+};
+
+// ============================= PACK READER ============================= //
+// Maps the whole pack read-only. Nothing is copied; entries point into the mapping, which
+// stays valid until close(). openMemory() reads a pack that is already in memory, such as
+// the one compiled into the executable by the EMBED_ASSETS build.
+class AssetPack
+{
+public:
+    bool open(const std::string &path)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+        length = (size_t)fileSize.QuadPart;
+        mapping = length > 0 ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+        base = mapping ? (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            length = (size_t)info.st_size;
+            void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            base = mapped == MAP_FAILED ? nullptr : (const uint8_t *)mapped;
+        }
+        ::close(fd);
+#endif
+        if (!base || !validate())
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    bool openMemory(const void *data, size_t size)
+    {
+        close();
+        base = (const uint8_t *)data;
+        length = size;
+        borrowed = true;
+        if (!validate())
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (borrowed)
+            base = nullptr;
+        borrowed = false;
+#ifdef _WIN32
+        if (base)
+            UnmapViewOfFile(base);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (base)
+            munmap((void *)base, length);
+#endif
+        base = nullptr;
+        length = 0;
+        entries = nullptr;
+        count = 0;
+    }
+
+    bool isOpen() const { return base != nullptr; }
+
+    const PackEntry *find(const char *name) const
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (strncmp(entries[i].name, name, PACK_NAME_LENGTH) == 0)
+                return &entries[i];
+        }
+        return nullptr;
+    }
+
+    const uint8_t *data(const PackEntry *entry) const { return base + entry->offset; }
+
+private:
+    const uint8_t *base = nullptr;
+    size_t length = 0;
+    const PackEntry *entries = nullptr;
+    uint32_t count = 0;
+    bool borrowed = false;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+
+    // A truncated or foreign file is rejected as a whole rather than read past its end.
+    bool validate()
+    {
+        if (length < sizeof(PackHeader))
+            return false;
+        const PackHeader *header = (const PackHeader *)base;
+        if (header->magic != PACK_MAGIC || header->version != PACK_VERSION ||
+            header->entryCount > (length - sizeof(PackHeader)) / sizeof(PackEntry))
+            return false;
+        entries = (const PackEntry *)(base + sizeof(PackHeader));
+        count = header->entryCount;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (entries[i].offset > length || entries[i].size > length - entries[i].offset ||
+                entries[i].name[PACK_NAME_LENGTH - 1] != '\0')
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
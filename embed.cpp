@@ -0,0 +1,66 @@
+// ============================= ASSET EMBEDDER ============================= //
+// Turns a file into a C++ header holding it as one 64-byte-aligned byte array, so the
+// EMBED_ASSETS build can compile assets.pack straight into the executable. The bytes are
+// written as string literals, which compilers get through far faster than a list of numbers.
+//
+// Usage: embed INPUT OUTPUT [NAME]
+//   INPUT    file to embed, normally assets.pack
+//   OUTPUT   header to write, normally embedded_assets.h
+//   NAME     array name (default embeddedAssetPack); NAME_SIZE holds its length in bytes
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <iterator>
+
+using namespace std;
+
+#define EMBED_BYTES_PER_LINE 64
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        cerr << "Usage: embed INPUT OUTPUT [NAME]" << endl;
+        return 1;
+    }
+    string name = argc > 3 ? argv[3] : "embeddedAssetPack";
+
+    ifstream in(argv[1], ios::binary);
+    if (!in.is_open())
+    {
+        cerr << "Could not read " << argv[1] << endl;
+        return 1;
+    }
+    vector<unsigned char> bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    ofstream out(argv[2]);
+    if (!out.is_open())
+    {
+        cerr << "Could not write " << argv[2] << endl;
+        return 1;
+    }
+    out << "// Generated by embed from " << argv[1] << "; do not edit.\n";
+    out << "#pragma once\n\n";
+    out << "#define " << name << "_SIZE " << bytes.size() << "\n\n";
+    // The literal's terminating zero is the one byte beyond the data.
+    out << "alignas(64) static const unsigned char " << name << "[" << bytes.size() + 1 << "] =\n";
+    const char *hex = "0123456789abcdef";
+    string line;
+    for (size_t i = 0; i < bytes.size(); ++i)
+    {
+        if (i % EMBED_BYTES_PER_LINE == 0)
+            line = "    \"";
+        line += "\\x";
+        line += hex[bytes[i] >> 4];
+        line += hex[bytes[i] & 15];
+        if (i % EMBED_BYTES_PER_LINE == EMBED_BYTES_PER_LINE - 1 || i + 1 == bytes.size())
+            out << line << "\"\n";
+    }
+    if (bytes.empty())
+        out << "    \"\"\n";
+    out << "    ;\n";
+
+    cout << "Embedded " << bytes.size() << " bytes of " << argv[1] << " as " << name << " in " << argv[2] << endl;
+    return out.good() ? 0 : 1;
+}
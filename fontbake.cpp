@@ -0,0 +1,89 @@
+// ============================= FONT BAKER ============================= //
+// Bakes a TTF at the given sizes into baked_font.h: the glyph metrics tables and the coverage
+// atlas as a 64-byte-aligned byte array. With it the BAKED_FONT (kiosk) build draws text
+// without SDL_ttf or FreeType at runtime.
+//
+// Usage: fontbake FONT OUTPUT SIZE...
+//   e.g. fontbake assets/Silkscreen-Regular.ttf baked_font.h 24 20
+#include "SDL2/SDL.h"
+#include "SDL2/SDL_ttf.h"
+#include "fontbake.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4)
+    {
+        cerr << "Usage: fontbake FONT OUTPUT SIZE..." << endl;
+        return 1;
+    }
+    if (TTF_Init() == -1)
+    {
+        cerr << "SDL_ttf could not initialize! SDL_ttf Error: " << TTF_GetError() << endl;
+        return 1;
+    }
+
+    BakedFontAtlas atlas;
+    for (int i = 3; i < argc; ++i)
+    {
+        int size = atoi(argv[i]);
+        TTF_Font *font = TTF_OpenFont(argv[1], size);
+        if (!bakeFontSize(font, size, atlas))
+        {
+            cerr << "Could not bake " << argv[1] << " at size " << size << ": " << TTF_GetError() << endl;
+            return 1;
+        }
+        TTF_CloseFont(font);
+    }
+    TTF_Quit();
+
+    ofstream out(argv[2]);
+    if (!out.is_open())
+    {
+        cerr << "Could not write " << argv[2] << endl;
+        return 1;
+    }
+    out << "// Generated by fontbake from " << argv[1] << "; do not edit.\n";
+    out << "#pragma once\n\n";
+    out << "#define BAKED_FONT_ATLAS_WIDTH " << atlas.width << "\n";
+    out << "#define BAKED_FONT_ATLAS_HEIGHT " << atlas.height << "\n";
+    out << "#define BAKED_FONT_SIZE_COUNT " << atlas.sizeCount << "\n\n";
+    out << "static const BakedFontSize bakedFontSizes[BAKED_FONT_SIZE_COUNT] = {\n";
+    for (int s = 0; s < atlas.sizeCount; ++s)
+    {
+        const BakedFontSize &baked = atlas.sizes[s];
+        out << "    {" << baked.size << ", " << baked.height << ", {\n";
+        for (int i = 0; i < FONT_CHAR_COUNT; ++i)
+        {
+            const BakedGlyph &g = baked.glyphs[i];
+            out << "        {" << g.x << ", " << g.y << ", " << g.w << ", " << g.h << ", " << g.offsetX << ", "
+                << g.offsetY << ", " << g.advance << "},\n";
+        }
+        out << "    }},\n";
+    }
+    out << "};\n\n";
+
+    // Written as string literals, like the embed tool; the terminating zero is one spare byte.
+    out << "alignas(64) static const unsigned char bakedFontCoverage[" << atlas.coverage.size() + 1 << "] =\n";
+    const char *hex = "0123456789abcdef";
+    for (size_t i = 0; i < atlas.coverage.size(); i += atlas.width)
+    {
+        string line = "    \"";
+        for (int x = 0; x < atlas.width; ++x)
+        {
+            line += "\\x";
+            line += hex[atlas.coverage[i + x] >> 4];
+            line += hex[atlas.coverage[i + x] & 15];
+        }
+        out << line << "\"\n";
+    }
+    out << "    ;\n";
+
+    cout << "Baked " << atlas.sizeCount << " sizes into a " << atlas.width << "x" << atlas.height << " atlas in " << argv[2] << endl;
+    return out.good() ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+#ifndef FONTBAKE_H
+#define FONTBAKE_H
+
+// ============================= FONT BAKING ============================= //
+// Rasterizes the printable ASCII glyphs of a font at a few sizes into one coverage atlas with
+// a metrics table; the game draws all text as quads from it. fontbake.cpp runs this at build
+// time and writes baked_font.h, so the kiosk build can leave SDL_ttf out. Other builds run it on
+// the TTF while loading. The tables need nothing, but baking needs SDL_ttf, so bakeFontSize()
+// only exists where SDL_ttf.h is included.
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#define FONT_FIRST_CHAR 32
+#define FONT_CHAR_COUNT 95
+#define FONT_MAX_SIZES 4
+#define FONT_ATLAS_WIDTH 256
+#define FONT_GLYPH_PADDING 1
+
+// Where a glyph sits in the atlas, where its top-left corner goes relative to the pen at the top
+// of the line, and how far the pen moves after it. Blank glyphs such as space have w = h = 0.
+struct BakedGlyph
+{
+    int16_t x, y, w, h;
+    int16_t offsetX, offsetY;
+    int16_t advance;
+};
+
+struct BakedFontSize
+{
+    int size;
+    int height;
+    BakedGlyph glyphs[FONT_CHAR_COUNT];
+};
+
+// Coverage is one byte per pixel, 0 or 255 like SDL_ttf's solid rendering.
+struct BakedFontAtlas
+{
+    int sizeCount = 0;
+    BakedFontSize sizes[FONT_MAX_SIZES];
+    int width = FONT_ATLAS_WIDTH;
+    int height = 0;
+    std::vector<uint8_t> coverage;
+};
+
+#ifdef SDL_TTF_H_
+// Adds one size to the atlas, its glyphs packed in rows below whatever is already there. Each
+// glyph is rendered on its own the way TTF_RenderText_Solid would place it, then cropped.
+inline bool bakeFontSize(TTF_Font *font, int size, BakedFontAtlas &atlas)
+{
+    if (!font || atlas.sizeCount >= FONT_MAX_SIZES)
+        return false;
+    BakedFontSize &baked = atlas.sizes[atlas.sizeCount++];
+    baked.size = size;
+    baked.height = TTF_FontHeight(font);
+
+    SDL_Color white = {255, 255, 255, 255};
+    int x = 0, y = atlas.height, rowHeight = 0;
+    for (int i = 0; i < FONT_CHAR_COUNT; ++i)
+    {
+        Uint16 ch = FONT_FIRST_CHAR + i;
+        BakedGlyph &glyph = baked.glyphs[i];
+        glyph = {};
+        int advance = 0;
+        if (TTF_GlyphMetrics(font, ch, NULL, NULL, NULL, NULL, &advance) == 0)
+            glyph.advance = (int16_t)advance;
+
+        // Solid rendering gives an 8-bit surface where index 0 is the background.
+        SDL_Surface *surface = TTF_RenderGlyph_Solid(font, ch, white);
+        if (!surface)
+            continue;
+        SDL_LockSurface(surface);
+        const Uint8 *pixels = (const Uint8 *)surface->pixels;
+        int left = surface->w, top = surface->h, right = -1, bottom = -1;
+        for (int sy = 0; sy < surface->h; ++sy)
+        {
+            for (int sx = 0; sx < surface->w; ++sx)
+            {
+                if (pixels[sy * surface->pitch + sx])
+                {
+                    left = std::min(left, sx);
+                    right = std::max(right, sx);
+                    top = std::min(top, sy);
+                    bottom = std::max(bottom, sy);
+                }
+            }
+        }
+        if (right >= left)
+        {
+            int w = right - left + 1, h = bottom - top + 1;
+            if (x + w > atlas.width)
+            {
+                x = 0;
+                y += rowHeight;
+                rowHeight = 0;
+            }
+            glyph.x = (int16_t)x;
+            glyph.y = (int16_t)y;
+            glyph.w = (int16_t)w;
+            glyph.h = (int16_t)h;
+            glyph.offsetX = (int16_t)left;
+            glyph.offsetY = (int16_t)top;
+            if (atlas.height < y + h + FONT_GLYPH_PADDING)
+            {
+                atlas.height = y + h + FONT_GLYPH_PADDING;
+                atlas.coverage.resize((size_t)atlas.width * atlas.height);
+            }
+            for (int row = 0; row < h; ++row)
+            {
+                for (int col = 0; col < w; ++col)
+                {
+                    bool set = pixels[(top + row) * surface->pitch + left + col] != 0;
+                    atlas.coverage[(size_t)(y + row) * atlas.width + x + col] = set ? 255 : 0;
+                }
+            }
+            x += w + FONT_GLYPH_PADDING;
+            rowHeight = std::max(rowHeight, h + FONT_GLYPH_PADDING);
+        }
+        SDL_UnlockSurface(surface);
+        SDL_FreeSurface(surface);
+    }
+    return true;
+}
+#endif
+
+#endif
@@ -1,9 +1,13 @@
 // ============================= INCLUDES ============================= //
-// Includes SDL2 libraries for graphics, text rendering, and audio.
+// Includes SDL2 libraries for graphics, text rendering, and audio; the kiosk build (BAKED_FONT)
+// draws text from a font baked at build time and leaves SDL_ttf out.
 // Includes standard C++ libraries for strings, vectors, math, file I/O, and random generation.
+// Includes the headless gameplay simulation shared with the offline tools, and the asset pack reader.
 #include "SDL2/SDL.h"
 #include "SDL2/SDL_image.h"
+#ifndef BAKED_FONT
 #include "SDL2/SDL_ttf.h"
+#endif
 #include "SDL2/SDL_mixer.h"
 #include <iostream>
 #include <string>
@@ -14,23 +18,35 @@
 #include <algorithm>
 #include <fstream>
 #include <random>
+#include <filesystem>
+#include <functional>
+#include <cerrno>
+#include <chrono>
+#include "simulation.h"
+#include "assetpack.h"
+#include "fontbake.h"
+#ifdef EMBED_ASSETS
+#include "embedded_assets.h"
+#endif
+#ifdef BAKED_FONT
+#include "baked_font.h"
+#endif
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#include <spawn.h>
+#include <sys/wait.h>
+extern char **environ;
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
-// ============================= DEFINITIONS ============================= //
-// Constants for screen size, car dimensions, and lane positions.
-// These values are used for scaling and positioning elements in the game.
-#define SCREEN_WIDTH 405
-#define SCREEN_HEIGHT 720
-#define CAR_WIDTH SCREEN_WIDTH / 10
-#define CAR_HEIGHT SCREEN_HEIGHT / 11
-#define LANE_WIDTH (SCREEN_WIDTH / 4)
-#define LANE_1 (LANE_WIDTH / 2 - CAR_WIDTH / 2)
-#define LANE_2 (LANE_WIDTH + LANE_WIDTH / 2 - CAR_WIDTH / 2)
-#define LANE_3 (2 * LANE_WIDTH + LANE_WIDTH / 2 - CAR_WIDTH / 2)
-#define LANE_4 (3 * LANE_WIDTH + LANE_WIDTH / 2 - CAR_WIDTH / 2)
-#define OBSTACLE_SIZE SCREEN_WIDTH / 10
-
 // ============================= GAME STATE ENUM ============================= //
 // Represents the game's current state (menu, active play, or game over).
 enum GameState
@@ -40,710 +56,4524 @@ enum GameState
     DEATH_SCREEN
 };
 
-// ============================= ENTITY CLASS ============================= //
-// Base class for renderable objects like cars or obstacles.
-// Manages texture, size, and rendering properties.
-class Entity
+// ============================= RENDER BACKENDS ============================= //
+// Everything the game draws goes through this small interface, so the drawing code does not
+// care what puts the pixels on screen. The SDL backend forwards to SDL_Renderer. The software
+// backend is our own CPU blitter into an SDL_Surface for machines without a GPU, where every
+// pixel loop can be profiled and tuned. Textures are opaque handles owned by the backend.
+class RenderTexture
 {
 public:
-    SDL_Texture *texture;
-    SDL_Rect srcRect, destRect;
-    bool collected = false;
+    int w = 0, h = 0;
+    virtual ~RenderTexture() {}
+};
 
-    // Draws the entity on the screen by copying its texture to the renderer.
-    void render(SDL_Renderer *renderer)
-    {
-        SDL_RenderCopy(renderer, texture, NULL, &destRect);
-    }
+// One textured quad multiplied by color (white leaves the texture as it is). Rotated sprites
+// come pre-rendered from the atlas, so quads are always axis-aligned.
+struct SpriteQuad
+{
+    SDL_Rect src;
+    SDL_Rect dst;
+    SDL_Color color;
 };
 
-// ============================= CAR CLASS ============================= //
-// Represents a player's car with added movement and rotation functionality.
-class Car : public Entity
+class RenderBackend
 {
 public:
-    double angle = 0;
-    bool rotating = false;
-    Uint32 rotationStartTime;
-    const Uint32 rotationDuration = 200;
-    bool moving = false;
-    int targetX;
-    Uint32 moveStartTime;
-    const Uint32 moveDuration = 200;
-
-    // Uses a sine wave to calculate the angle the car should rotate while moving.
-    void updateRotation()
-    {
-        Uint32 currentTime = SDL_GetTicks();
-        if (rotating)
-        {
-            Uint32 elapsedTime = currentTime - rotationStartTime;
-            if (elapsedTime < rotationDuration)
-            {
-                angle = 15 * sin((M_PI / rotationDuration) * elapsedTime);
-            }
-            else
-            {
-                angle = 0;
-                rotating = false;
-            }
-        }
-    }
+    virtual ~RenderBackend() {}
+    // Draws into the window, or into a frame in memory when window is null.
+    virtual bool init(SDL_Window *window, int width, int height) = 0;
+    virtual const char *name() = 0;
+    virtual void outputSize(int *width, int *height) = 0;
+    // Texture format that createTexture takes without converting, and the largest texture side (0 if unlimited).
+    virtual Uint32 textureFormat() = 0;
+    virtual int maxTextureSize() = 0;
+    virtual RenderTexture *createTexture(SDL_Surface *surface) = 0;
+    // A texture that can be drawn into, or null when the backend cannot render to textures.
+    virtual RenderTexture *createTarget(int width, int height) = 0;
+    virtual void destroyTexture(RenderTexture *texture) = 0;
+    // Redirects drawing into a target texture, or back to the frame when target is null.
+    virtual void setTarget(RenderTexture *target) = 0;
+    virtual void clear(SDL_Color color) = 0;
+    // Fills rect, or the whole target when rect is null, blending translucent colours.
+    virtual void fillRect(const SDL_Rect *rect, SDL_Color color) = 0;
+    virtual void copy(RenderTexture *texture, const SDL_Rect *src, const SDL_Rect *dst) = 0;
+    virtual void drawSprites(RenderTexture *texture, const SpriteQuad *quads, int count) = 0;
+    // Reads the frame that was just drawn as ARGB8888.
+    virtual bool readPixels(void *pixels, int pitch) = 0;
+    virtual void present() = 0;
+    virtual void destroy() = 0;
+};
 
-    // Make the car go smoothly when changing lanes.
-    void updateMovement()
+// -------------------------------- SDL backend -------------------------------- //
+// Picks the renderer's preferred texture format that has an alpha channel.
+Uint32 nativeTextureFormat(SDL_Renderer *renderer)
+{
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info) == 0)
     {
-        Uint32 currentTime = SDL_GetTicks();
-        if (moving)
+        for (Uint32 i = 0; i < info.num_texture_formats; ++i)
         {
-            Uint32 elapsedTime = currentTime - moveStartTime;
-            if (elapsedTime < moveDuration)
-            {
-                double t = (double)elapsedTime / moveDuration;
-                destRect.x = destRect.x + t * (targetX - destRect.x);
-            }
-            else
-            {
-                destRect.x = targetX;
-                moving = false;
-            }
+            Uint32 format = info.texture_formats[i];
+            if (SDL_ISPIXELFORMAT_ALPHA(format) && !SDL_ISPIXELFORMAT_FOURCC(format) && SDL_BYTESPERPIXEL(format) == 4)
+                return format;
         }
     }
-};
+    return SDL_PIXELFORMAT_ARGB8888;
+}
 
-// ============================= GAME CLASS ============================= //
-// Manages the game loop, event handling, rendering, and state transitions.
-class Game
+class SdlTexture : public RenderTexture
 {
 public:
-    Game();
-    ~Game();
+    SDL_Texture *texture = nullptr;
+};
 
-    void init(const char *title, int xpos, int ypos, int width, int height, bool fullscreen);
-    void handleEvents();
-    void update();
-    void render();
-    void clean();
-    bool running() { return isRunning; };
+class SdlBackend : public RenderBackend
+{
+public:
+    bool init(SDL_Window *window, int width, int height) override;
+    const char *name() override { return frameSurface ? "SDL software renderer" : "SDL renderer"; }
+    void outputSize(int *width, int *height) override { SDL_GetRendererOutputSize(renderer, width, height); }
+    Uint32 textureFormat() override { return format; }
+    int maxTextureSize() override;
+    RenderTexture *createTexture(SDL_Surface *surface) override;
+    RenderTexture *createTarget(int width, int height) override;
+    void destroyTexture(RenderTexture *texture) override;
+    void setTarget(RenderTexture *target) override;
+    void clear(SDL_Color color) override;
+    void fillRect(const SDL_Rect *rect, SDL_Color color) override;
+    void copy(RenderTexture *texture, const SDL_Rect *src, const SDL_Rect *dst) override;
+    void drawSprites(RenderTexture *texture, const SpriteQuad *quads, int count) override;
+    bool readPixels(void *pixels, int pitch) override;
+    void present() override { SDL_RenderPresent(renderer); }
+    void destroy() override;
 
 private:
-    bool isRunning;
-    GameState currentState;
-    SDL_Window *window;
-    SDL_Renderer *renderer;
-    vector<Entity> obstacles;
-    Car blueCar, redCar;
-    Uint32 startTime;
-    int score = 0;
-    int spawnRate = 80;
-    int obstacleSpeed = 6;
-    int playTextYPosition;
-    int playTextDirection;
-    const int textSpeed = 1;
-    const int animationRange = 10;
-    TTF_Font *titleFont;
-    TTF_Font *menuFont;
-    SDL_Texture *titleTextTexture;
-    SDL_Texture *playTextTexture1;
-    SDL_Texture *playTextTexture2;
-    SDL_Rect titleTextRect;
-    SDL_Rect playTextRect1;
-    SDL_Rect playTextRect2;
-    int initialPlayTextYPosition;
-    Mix_Chunk *circlePickupSound;
-    Mix_Chunk *deathSound;
-    Mix_Chunk *circleMissSound;
-    SDL_Texture *redCircle;
-    SDL_Texture *redBox;
-    SDL_Texture *blueCircle;
-    SDL_Texture *blueBox;
-    SDL_Rect restartButtonRect, homeButtonRect;
-    Mix_Music *backgroundMusic;
-    int highscore = 0;
-
-    void loadAssets();
-    void spawnObstacle();
-    void updateObstacles();
-    void checkCollision();
-    void increaseDifficulty();
-    void updateMenuAnimation();
-    void resetCars();
-    void renderMenu();
-    void renderDeathScreen();
-    void loadHighscore();
-    void saveHighscore();
+    SDL_Renderer *renderer = nullptr;
+    SDL_Surface *frameSurface = nullptr;
+    Uint32 format = SDL_PIXELFORMAT_ARGB8888;
+    vector<SDL_Vertex> vertices;
+    vector<int> indices;
+    vector<Uint32> readback;
+    int width = 0, height = 0;
 };
 
-Game::Game() {}
-Game::~Game() {}
+// A window renderer keeps the game's coordinates at width x height whatever the pixel density:
+// on a high-DPI display SDL scales every draw up to the real output, so sprites baked at that
+// density come out sharp.
+bool SdlBackend::init(SDL_Window *window, int frameWidth, int frameHeight)
+{
+    width = frameWidth;
+    height = frameHeight;
+    if (window)
+    {
+        renderer = SDL_CreateRenderer(window, -1, 0);
+        if (renderer)
+            SDL_RenderSetLogicalSize(renderer, width, height);
+    }
+    else
+    {
+        frameSurface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+        renderer = frameSurface ? SDL_CreateSoftwareRenderer(frameSurface) : nullptr;
+    }
+    if (!renderer)
+    {
+        return false;
+    }
+    format = nativeTextureFormat(renderer);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    return true;
+}
 
-// ============================= INIT METHOD ============================= //
-// Sets up SDL systems, creates the game window, loads assets, and initializes the game state.
-void Game::init(const char *title, int xpos, int ypos, int width, int height, bool fullscreen)
+int SdlBackend::maxTextureSize()
 {
-    int flags = 0;
-    if (fullscreen)
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info) != 0)
+        return 0;
+    return min(info.max_texture_width, info.max_texture_height);
+}
+
+// Uploads the surface as it is when it is already in the renderer's native format.
+RenderTexture *SdlBackend::createTexture(SDL_Surface *surface)
+{
+    SDL_Surface *converted = surface->format->format == format ? surface : SDL_ConvertSurfaceFormat(surface, format, 0);
+    if (!converted)
+        return nullptr;
+    SDL_Texture *texture = SDL_CreateTexture(renderer, format, SDL_TEXTUREACCESS_STATIC, converted->w, converted->h);
+    if (texture)
     {
-        flags = SDL_WINDOW_FULLSCREEN;
+        SDL_UpdateTexture(texture, NULL, converted->pixels, converted->pitch);
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
     }
-    if (SDL_Init(SDL_INIT_EVERYTHING) == 0)
+    if (converted != surface)
+        SDL_FreeSurface(converted);
+    if (!texture)
+        return nullptr;
+
+    SdlTexture *result = new SdlTexture();
+    result->texture = texture;
+    result->w = surface->w;
+    result->h = surface->h;
+    return result;
+}
+
+RenderTexture *SdlBackend::createTarget(int width, int height)
+{
+    if (!SDL_RenderTargetSupported(renderer))
+        return nullptr;
+    SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, width, height);
+    if (!texture)
+        return nullptr;
+    SdlTexture *result = new SdlTexture();
+    result->texture = texture;
+    result->w = width;
+    result->h = height;
+    return result;
+}
+
+void SdlBackend::destroyTexture(RenderTexture *texture)
+{
+    if (texture)
     {
-        window = SDL_CreateWindow(title, xpos, ypos, width, height, flags);
-        renderer = SDL_CreateRenderer(window, -1, 0);
-        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+        SDL_DestroyTexture(static_cast<SdlTexture *>(texture)->texture);
+        delete texture;
+    }
+}
 
-        if (TTF_Init() == -1)
+void SdlBackend::setTarget(RenderTexture *target)
+{
+    SDL_SetRenderTarget(renderer, target ? static_cast<SdlTexture *>(target)->texture : NULL);
+}
+
+void SdlBackend::clear(SDL_Color color)
+{
+    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+    SDL_RenderClear(renderer);
+}
+
+void SdlBackend::fillRect(const SDL_Rect *rect, SDL_Color color)
+{
+    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+    SDL_RenderFillRect(renderer, rect);
+}
+
+void SdlBackend::copy(RenderTexture *texture, const SDL_Rect *src, const SDL_Rect *dst)
+{
+    if (texture)
+        SDL_RenderCopy(renderer, static_cast<SdlTexture *>(texture)->texture, src, dst);
+}
+
+// All quads go out as one SDL_RenderGeometry call.
+// The buffers only grow, so a steady frame does not allocate.
+void SdlBackend::drawSprites(RenderTexture *texture, const SpriteQuad *quads, int count)
+{
+    if (!texture || count == 0)
+        return;
+    if ((int)vertices.size() < count * 4)
+    {
+        vertices.resize(count * 4);
+        int first = indices.size() / 6;
+        indices.resize(count * 6);
+        for (int i = first; i < count; ++i)
         {
-            cerr << "SDL_ttf could not initialize! SDL_ttf Error: " << TTF_GetError() << endl;
-            isRunning = false;
-            return;
+            indices[i * 6 + 0] = i * 4 + 0;
+            indices[i * 6 + 1] = i * 4 + 1;
+            indices[i * 6 + 2] = i * 4 + 2;
+            indices[i * 6 + 3] = i * 4 + 2;
+            indices[i * 6 + 4] = i * 4 + 3;
+            indices[i * 6 + 5] = i * 4 + 0;
         }
+    }
+
+    float texelWidth = 1.0f / texture->w, texelHeight = 1.0f / texture->h;
+    for (int q = 0; q < count; ++q)
+    {
+        const SDL_Rect &src = quads[q].src;
+        const SDL_Rect &dst = quads[q].dst;
+        float u0 = src.x * texelWidth, v0 = src.y * texelHeight;
+        float u1 = (src.x + src.w) * texelWidth, v1 = (src.y + src.h) * texelHeight;
+        float x0 = (float)dst.x, y0 = (float)dst.y;
+        float x1 = (float)(dst.x + dst.w), y1 = (float)(dst.y + dst.h);
 
-        if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048) < 0)
+        const float corners[4][4] = {{x0, y0, u0, v0}, {x1, y0, u1, v0}, {x1, y1, u1, v1}, {x0, y1, u0, v1}};
+        SDL_Vertex *vertex = &vertices[q * 4];
+        for (int i = 0; i < 4; ++i)
         {
-            cerr << "SDL_mixer could not initialize! SDL_mixer Error: " << Mix_GetError() << endl;
+            vertex[i].position.x = corners[i][0];
+            vertex[i].position.y = corners[i][1];
+            vertex[i].color = quads[q].color;
+            vertex[i].tex_coord.x = corners[i][2];
+            vertex[i].tex_coord.y = corners[i][3];
         }
+    }
+    SDL_RenderGeometry(renderer, static_cast<SdlTexture *>(texture)->texture, vertices.data(), count * 4, indices.data(), count * 6);
+}
 
-        isRunning = true;
-        currentState = MAIN_MENU;
-        loadAssets();
-        startTime = SDL_GetTicks();
-        loadHighscore();
+// Headless frames already live in memory; with a window the back buffer is read before it is presented.
+bool SdlBackend::readPixels(void *pixels, int pitch)
+{
+    if (frameSurface)
+    {
+        return SDL_ConvertPixels(frameSurface->w, frameSurface->h, frameSurface->format->format, frameSurface->pixels,
+                                 frameSurface->pitch, SDL_PIXELFORMAT_ARGB8888, pixels, pitch) == 0;
+    }
+    float scaleX, scaleY;
+    SDL_RenderGetScale(renderer, &scaleX, &scaleY);
+    if (scaleX == 1 && scaleY == 1)
+    {
+        return SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_ARGB8888, pixels, pitch) == 0;
+    }
+    // A scaled window reads back its viewport in output pixels, without the letterbox bars; it is
+    // sampled down to the game size. The buffer has the whole output's pitch so the read always fits.
+    SDL_Rect viewport;
+    SDL_RenderGetViewport(renderer, &viewport);
+    int outputWidth, outputHeight;
+    SDL_GetRendererOutputSize(renderer, &outputWidth, &outputHeight);
+    int readWidth = max(1, min(outputWidth, (int)(viewport.w * scaleX)));
+    int readHeight = max(1, min(outputHeight, (int)(viewport.h * scaleY)));
+    readback.resize((size_t)outputWidth * outputHeight);
+    if (SDL_RenderReadPixels(renderer, NULL, SDL_PIXELFORMAT_ARGB8888, readback.data(), outputWidth * 4) != 0)
+        return false;
+    for (int y = 0; y < height; ++y)
+    {
+        const Uint32 *in = readback.data() + (size_t)min(readHeight - 1, (int)(y * scaleY)) * outputWidth;
+        Uint32 *out = (Uint32 *)((Uint8 *)pixels + y * pitch);
+        for (int x = 0; x < width; ++x)
+            out[x] = in[min(readWidth - 1, (int)(x * scaleX))];
+    }
+    return true;
+}
+
+void SdlBackend::destroy()
+{
+    SDL_DestroyRenderer(renderer);
+    renderer = nullptr;
+    SDL_FreeSurface(frameSurface);
+    frameSurface = nullptr;
+}
+
+// ------------------------------ Software backend ------------------------------ //
+// Every surface is premultiplied ARGB8888, so blending a pixel is
+//     dst = src + dst * (255 - srcAlpha) / 255
+// on all four channels with no division by alpha. Rows are blended four pixels at a time with
+// SSE2 where the compiler targets it (always on x86-64), with a scalar loop for the rest.
+// Runs of fully transparent or fully opaque source pixels skip the arithmetic.
+
+// x / 255 rounded, exact for x up to 255 * 255.
+inline Uint32 divide255(Uint32 x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// Blends one premultiplied pixel over another, two channels per multiply.
+inline Uint32 blendPixel(Uint32 src, Uint32 dst)
+{
+    Uint32 inverse = 255 - (src >> 24);
+    Uint32 rb = (dst & 0x00FF00FF) * inverse + 0x00800080;
+    rb = ((rb + ((rb >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+    Uint32 ag = ((dst >> 8) & 0x00FF00FF) * inverse + 0x00800080;
+    ag = (ag + ((ag >> 8) & 0x00FF00FF)) & 0xFF00FF00;
+    return src + rb + ag;
+}
+
+inline Uint32 premultiply(SDL_Color color)
+{
+    return ((Uint32)color.a << 24) | (divide255(color.r * color.a) << 16) | (divide255(color.g * color.a) << 8) | divide255(color.b * color.a);
+}
+
+// Multiplies a premultiplied texel by a premultiplied colour, channel by channel.
+inline Uint32 modulatePixel(Uint32 texel, Uint32 color)
+{
+    Uint32 result = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        result |= divide255(((texel >> shift) & 0xFF) * ((color >> shift) & 0xFF)) << shift;
+    }
+    return result;
+}
+
+#ifdef __SSE2__
+// Blends four premultiplied pixels over four others, using the same rounding as blendPixel.
+inline __m128i blendPixels(__m128i src, __m128i dst, __m128i alpha)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    __m128i inverse = _mm_sub_epi32(_mm_set1_epi32(255), alpha);
+    inverse = _mm_packs_epi32(inverse, inverse);
+    inverse = _mm_unpacklo_epi16(inverse, inverse);
+    __m128i inverseLo = _mm_unpacklo_epi32(inverse, inverse);
+    __m128i inverseHi = _mm_unpackhi_epi32(inverse, inverse);
 
-        if (isRunning)
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(dst, zero), inverseLo), bias);
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(dst, zero), inverseHi), bias);
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+    return _mm_add_epi8(src, _mm_packus_epi16(lo, hi));
+}
+#endif
+
+void blendRow(Uint32 *dst, const Uint32 *src, int count)
+{
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i opaque = _mm_set1_epi32(255);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i alpha = _mm_srli_epi32(s, 24);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero)) == 0xFFFF)
+            continue;
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, opaque)) == 0xFFFF)
         {
-            if (Mix_PlayMusic(backgroundMusic, -1) == -1)
-            {
-                cerr << "Failed to play background music! SDL_mixer Error: " << Mix_GetError() << endl;
-            }
+            _mm_storeu_si128((__m128i *)(dst + i), s);
+            continue;
         }
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        _mm_storeu_si128((__m128i *)(dst + i), blendPixels(s, d, alpha));
     }
-    else
+#endif
+    for (; i < count; ++i)
     {
-        isRunning = false;
+        Uint32 alpha = src[i] >> 24;
+        if (alpha == 255)
+            dst[i] = src[i];
+        else if (alpha != 0)
+            dst[i] = blendPixel(src[i], dst[i]);
     }
 }
 
-// ============================= ASSET LOADING ============================= //
-// Loads textures, sounds, and fonts needed for the game.
-// Also sets default positions and properties for cars and obstacles.
-void Game::loadAssets()
+// Blends one premultiplied colour over a row; an opaque colour is a plain fill.
+void fillRow(Uint32 *dst, Uint32 color, int count)
+{
+    Uint32 alpha = color >> 24;
+    if (alpha == 255)
+    {
+        fill(dst, dst + count, color);
+        return;
+    }
+    if (alpha == 0)
+        return;
+    int i = 0;
+#ifdef __SSE2__
+    __m128i s = _mm_set1_epi32((int)color);
+    __m128i alphas = _mm_set1_epi32((int)alpha);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        _mm_storeu_si128((__m128i *)(dst + i), blendPixels(s, d, alphas));
+    }
+#endif
+    for (; i < count; ++i)
+        dst[i] = blendPixel(color, dst[i]);
+}
+
+// Clips a destination rectangle to the target and moves the source rectangle with it (1:1 copies only).
+bool clipCopy(SDL_Rect &src, SDL_Rect &dst, int targetWidth, int targetHeight)
+{
+    if (dst.x < 0)
+    {
+        src.x -= dst.x;
+        src.w += dst.x;
+        dst.w += dst.x;
+        dst.x = 0;
+    }
+    if (dst.y < 0)
+    {
+        src.y -= dst.y;
+        src.h += dst.y;
+        dst.h += dst.y;
+        dst.y = 0;
+    }
+    dst.w = src.w = min(dst.w, targetWidth - dst.x);
+    dst.h = src.h = min(dst.h, targetHeight - dst.y);
+    return dst.w > 0 && dst.h > 0;
+}
+
+class SoftwareTexture : public RenderTexture
 {
-    SDL_Surface *tmpSurface;
+public:
+    SDL_Surface *surface = nullptr;
+};
 
-    tmpSurface = IMG_Load("assets/icon.png");
-    SDL_SetWindowIcon(window, tmpSurface);
-    SDL_FreeSurface(tmpSurface);
+class SoftwareBackend : public RenderBackend
+{
+public:
+    bool init(SDL_Window *window, int width, int height) override;
+    const char *name() override { return "software blitter"; }
+    void outputSize(int *width, int *height) override;
+    Uint32 textureFormat() override { return SDL_PIXELFORMAT_ARGB8888; }
+    int maxTextureSize() override { return 0; }
+    RenderTexture *createTexture(SDL_Surface *surface) override;
+    RenderTexture *createTarget(int width, int height) override;
+    void destroyTexture(RenderTexture *texture) override;
+    void setTarget(RenderTexture *target) override;
+    void clear(SDL_Color color) override;
+    void fillRect(const SDL_Rect *rect, SDL_Color color) override;
+    void copy(RenderTexture *texture, const SDL_Rect *src, const SDL_Rect *dst) override;
+    void drawSprites(RenderTexture *texture, const SpriteQuad *quads, int count) override;
+    bool readPixels(void *pixels, int pitch) override;
+    void present() override;
+    void destroy() override;
 
-    tmpSurface = IMG_Load("assets/car-red.png");
-    redCar.texture = SDL_CreateTextureFromSurface(renderer, tmpSurface);
-    SDL_FreeSurface(tmpSurface);
+private:
+    SDL_Window *window = nullptr;
+    SDL_Surface *screen = nullptr;
+    SDL_Surface *target = nullptr;
+    bool ownsScreen = false;
 
-    tmpSurface = IMG_Load("assets/car-blue.png");
-    blueCar.texture = SDL_CreateTextureFromSurface(renderer, tmpSurface);
-    SDL_FreeSurface(tmpSurface);
+    void blit(SDL_Surface *source, SDL_Rect src, SDL_Rect dst);
+    void drawTinted(SDL_Surface *source, const SDL_Rect &src, const SDL_Rect &dst, SDL_Color color);
+};
 
-    tmpSurface = IMG_Load("assets/circle-red.png");
-    redCircle = SDL_CreateTextureFromSurface(renderer, tmpSurface);
-    SDL_FreeSurface(tmpSurface);
+// Draws straight into the window surface when it is 32-bit BGRA in memory, otherwise into
+// a frame of our own that is converted on present.
+bool SoftwareBackend::init(SDL_Window *gameWindow, int width, int height)
+{
+    window = gameWindow;
+    SDL_Surface *windowSurface = window ? SDL_GetWindowSurface(window) : nullptr;
+    if (window && !windowSurface)
+    {
+        return false;
+    }
+    if (windowSurface && (windowSurface->format->format == SDL_PIXELFORMAT_ARGB8888 || windowSurface->format->format == SDL_PIXELFORMAT_RGB888))
+    {
+        screen = windowSurface;
+    }
+    else
+    {
+        screen = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+        ownsScreen = true;
+        if (screen)
+            SDL_SetSurfaceBlendMode(screen, SDL_BLENDMODE_NONE);
+    }
+    target = screen;
+    return screen != nullptr;
+}
 
-    tmpSurface = IMG_Load("assets/box-red.png");
-    redBox = SDL_CreateTextureFromSurface(renderer, tmpSurface);
-    SDL_FreeSurface(tmpSurface);
+void SoftwareBackend::outputSize(int *width, int *height)
+{
+    if (width)
+        *width = screen->w;
+    if (height)
+        *height = screen->h;
+}
 
-    tmpSurface = IMG_Load("assets/circle-blue.png");
-    blueCircle = SDL_CreateTextureFromSurface(renderer, tmpSurface);
-    SDL_FreeSurface(tmpSurface);
+RenderTexture *SoftwareBackend::createTexture(SDL_Surface *surface)
+{
+    SDL_Surface *pixels = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+    if (!pixels)
+        return nullptr;
+    SDL_PremultiplyAlpha(pixels->w, pixels->h, SDL_PIXELFORMAT_ARGB8888, pixels->pixels, pixels->pitch,
+                         SDL_PIXELFORMAT_ARGB8888, pixels->pixels, pixels->pitch);
+    SoftwareTexture *result = new SoftwareTexture();
+    result->surface = pixels;
+    result->w = pixels->w;
+    result->h = pixels->h;
+    return result;
+}
 
-    tmpSurface = IMG_Load("assets/box-blue.png");
-    blueBox = SDL_CreateTextureFromSurface(renderer, tmpSurface);
-    SDL_FreeSurface(tmpSurface);
+RenderTexture *SoftwareBackend::createTarget(int width, int height)
+{
+    SDL_Surface *pixels = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (!pixels)
+        return nullptr;
+    SoftwareTexture *result = new SoftwareTexture();
+    result->surface = pixels;
+    result->w = width;
+    result->h = height;
+    return result;
+}
 
-    circlePickupSound = Mix_LoadWAV("assets/sfx/circle_pickup.wav");
-    deathSound = Mix_LoadWAV("assets/sfx/death-car.wav");
-    circleMissSound = Mix_LoadWAV("assets/sfx/circle_miss.wav");
+void SoftwareBackend::destroyTexture(RenderTexture *texture)
+{
+    if (!texture)
+        return;
+    SDL_FreeSurface(static_cast<SoftwareTexture *>(texture)->surface);
+    delete texture;
+}
 
-    blueCar.destRect = {LANE_1, SCREEN_HEIGHT - 100, CAR_WIDTH, CAR_HEIGHT};
-    redCar.destRect = {LANE_4, SCREEN_HEIGHT - 100, CAR_WIDTH, CAR_HEIGHT};
+void SoftwareBackend::setTarget(RenderTexture *texture)
+{
+    target = texture ? static_cast<SoftwareTexture *>(texture)->surface : screen;
+}
 
-    restartButtonRect = {SCREEN_WIDTH / 2 - 50, SCREEN_HEIGHT / 2 - 20, 100, 40};
-    homeButtonRect = {SCREEN_WIDTH / 2 - 50, SCREEN_HEIGHT / 2 + 30, 100, 40};
+void SoftwareBackend::clear(SDL_Color color)
+{
+    SDL_FillRect(target, NULL, premultiply(color));
+}
 
-    titleFont = TTF_OpenFont("assets/Silkscreen-Regular.ttf", 24);
-    menuFont = TTF_OpenFont("assets/Silkscreen-Regular.ttf", 20);
-    if (titleFont && menuFont)
+void SoftwareBackend::fillRect(const SDL_Rect *rect, SDL_Color color)
+{
+    SDL_Rect area = {0, 0, target->w, target->h};
+    if (rect && !SDL_IntersectRect(rect, &area, &area))
+        return;
+    Uint32 pixel = premultiply(color);
+    for (int y = area.y; y < area.y + area.h; ++y)
     {
-        SDL_Color color = {255, 255, 255, 255};
+        fillRow((Uint32 *)((Uint8 *)target->pixels + y * target->pitch) + area.x, pixel, area.w);
+    }
+}
 
-        SDL_Surface *titleSurface = TTF_RenderText_Solid(titleFont, "Two Cars Game", color);
-        titleTextTexture = SDL_CreateTextureFromSurface(renderer, titleSurface);
-        titleTextRect = {SCREEN_WIDTH / 2 - titleSurface->w / 2, SCREEN_HEIGHT / 3 - titleSurface->h / 2, titleSurface->w, titleSurface->h};
-        SDL_FreeSurface(titleSurface);
+// Blends source pixels 1:1 onto the target, clipped to it.
+void SoftwareBackend::blit(SDL_Surface *source, SDL_Rect src, SDL_Rect dst)
+{
+    if (!clipCopy(src, dst, target->w, target->h))
+        return;
+    for (int y = 0; y < dst.h; ++y)
+    {
+        const Uint32 *in = (const Uint32 *)((const Uint8 *)source->pixels + (src.y + y) * source->pitch) + src.x;
+        Uint32 *out = (Uint32 *)((Uint8 *)target->pixels + (dst.y + y) * target->pitch) + dst.x;
+        blendRow(out, in, dst.w);
+    }
+}
 
-        SDL_Surface *playSurface1 = TTF_RenderText_Solid(menuFont, "Press Any Key", color);
-        playTextTexture1 = SDL_CreateTextureFromSurface(renderer, playSurface1);
-        playTextRect1 = {SCREEN_WIDTH / 2 - playSurface1->w / 2, SCREEN_HEIGHT / 2 - playSurface1->h, playSurface1->w, playSurface1->h};
-        SDL_FreeSurface(playSurface1);
+// Same-size copies are row blits; scaled ones (rare, e.g. high-DPI sprites) use nearest-neighbour sampling.
+void SoftwareBackend::copy(RenderTexture *texture, const SDL_Rect *srcRect, const SDL_Rect *dstRect)
+{
+    if (!texture)
+        return;
+    SDL_Surface *source = static_cast<SoftwareTexture *>(texture)->surface;
+    SDL_Rect src = srcRect ? *srcRect : SDL_Rect{0, 0, source->w, source->h};
+    SDL_Rect dst = dstRect ? *dstRect : SDL_Rect{0, 0, target->w, target->h};
+    if (src.w == dst.w && src.h == dst.h)
+    {
+        blit(source, src, dst);
+        return;
+    }
 
-        SDL_Surface *playSurface2 = TTF_RenderText_Solid(menuFont, "to Play", color);
-        playTextTexture2 = SDL_CreateTextureFromSurface(renderer, playSurface2);
-        playTextRect2 = {SCREEN_WIDTH / 2 - playSurface2->w / 2, SCREEN_HEIGHT / 2, playSurface2->w, playSurface2->h};
-        SDL_FreeSurface(playSurface2);
+    SDL_Rect bounds = {0, 0, target->w, target->h}, area;
+    if (!SDL_IntersectRect(&dst, &bounds, &area))
+        return;
+    for (int y = area.y; y < area.y + area.h; ++y)
+    {
+        int sy = src.y + (y - dst.y) * src.h / dst.h;
+        const Uint32 *in = (const Uint32 *)((const Uint8 *)source->pixels + sy * source->pitch);
+        Uint32 *out = (Uint32 *)((Uint8 *)target->pixels + y * target->pitch);
+        for (int x = area.x; x < area.x + area.w; ++x)
+        {
+            out[x] = blendPixel(in[src.x + (x - dst.x) * src.w / dst.w], out[x]);
+        }
     }
-    playTextYPosition = playTextRect1.y;
-    initialPlayTextYPosition = playTextRect1.y;
-    playTextDirection = 1;
+}
+
+// Tinted quads (particles) are small, so they are sampled nearest-neighbour pixel by pixel.
+void SoftwareBackend::drawTinted(SDL_Surface *source, const SDL_Rect &src, const SDL_Rect &dst, SDL_Color color)
+{
+    SDL_Rect bounds = {0, 0, target->w, target->h}, area;
+    if (dst.w <= 0 || dst.h <= 0 || !SDL_IntersectRect(&dst, &bounds, &area))
+        return;
+    Uint32 tint = premultiply(color);
+    for (int y = area.y; y < area.y + area.h; ++y)
+    {
+        int sy = src.y + (y - dst.y) * src.h / dst.h;
+        const Uint32 *in = (const Uint32 *)((const Uint8 *)source->pixels + sy * source->pitch);
+        Uint32 *out = (Uint32 *)((Uint8 *)target->pixels + y * target->pitch);
+        for (int x = area.x; x < area.x + area.w; ++x)
+        {
+            out[x] = blendPixel(modulatePixel(in[src.x + (x - dst.x) * src.w / dst.w], tint), out[x]);
+        }
+    }
+}
+
+void SoftwareBackend::drawSprites(RenderTexture *texture, const SpriteQuad *quads, int count)
+{
+    if (!texture)
+        return;
+    SDL_Surface *source = static_cast<SoftwareTexture *>(texture)->surface;
+    for (int i = 0; i < count; ++i)
+    {
+        const SDL_Color &color = quads[i].color;
+        if (color.r != 255 || color.g != 255 || color.b != 255 || color.a != 255)
+        {
+            drawTinted(source, quads[i].src, quads[i].dst, color);
+            continue;
+        }
+        copy(texture, &quads[i].src, &quads[i].dst);
+    }
+}
+
+bool SoftwareBackend::readPixels(void *pixels, int pitch)
+{
+    return SDL_ConvertPixels(screen->w, screen->h, screen->format->format, screen->pixels, screen->pitch,
+                             SDL_PIXELFORMAT_ARGB8888, pixels, pitch) == 0;
+}
+
+void SoftwareBackend::present()
+{
+    if (!window)
+        return;
+    if (ownsScreen)
+    {
+        SDL_BlitSurface(screen, NULL, SDL_GetWindowSurface(window), NULL);
+    }
+    SDL_UpdateWindowSurface(window);
+}
+
+void SoftwareBackend::destroy()
+{
+    if (ownsScreen)
+        SDL_FreeSurface(screen);
+    screen = target = nullptr;
+}
+
+// ============================= RESOURCES ============================= //
+// Textures, sounds and music are owned through handles and registered with their size in bytes,
+// so memory can be reported against a budget and leaks are listed at exit.
+enum ResourceKind
+{
+    RESOURCE_TEXTURE,
+    RESOURCE_SOUND,
+    RESOURCE_MUSIC,
+    RESOURCE_MAPPING, // a memory-mapped file, such as the decoded music cache
+    RESOURCE_KIND_COUNT
+};
+
+const char *resourceKindNames[RESOURCE_KIND_COUNT] = {"textures", "sounds", "music", "mapped"};
 
-    backgroundMusic = Mix_LoadMUS("assets/sfx/background-music.mp3");
-    if (!backgroundMusic)
+template <typename T>
+class ResourceHandle;
+typedef ResourceHandle<RenderTexture> TextureHandle;
+typedef ResourceHandle<Mix_Chunk> SoundHandle;
+typedef ResourceHandle<Mix_Music> MusicHandle;
+typedef ResourceHandle<AssetPack> MappingHandle;
+
+class ResourceRegistry
+{
+public:
+    size_t budget = 0; // bytes; 0 for no budget
+
+    bool init(RenderBackend *registryBackend);
+    TextureHandle texture(const char *name, RenderTexture *texture);
+    SoundHandle sound(const char *name, Mix_Chunk *chunk);
+    MusicHandle music(const char *name, Mix_Music *music, size_t bytes);
+    MappingHandle mapping(const char *name, AssetPack *file, size_t bytes);
+    void release(int id);
+    void report(const char *when);
+    void checkGrowth();
+    void checkLeaks();
+    void destroy();
+
+private:
+    struct Entry
+    {
+        ResourceKind kind;
+        const char *name;
+        void *resource;
+        size_t bytes;
+        bool alive;
+    };
+    vector<Entry> entries;
+    RenderBackend *backend = nullptr;
+    SDL_mutex *lock = nullptr;
+    size_t bytes[RESOURCE_KIND_COUNT] = {};
+    int counts[RESOURCE_KIND_COUNT] = {};
+    size_t total = 0, peak = 0;
+    bool overBudget = false;
+    int lastCount = -1;
+    size_t lastBytes = 0;
+
+    int add(ResourceKind kind, const char *name, void *resource, size_t size);
+    int liveCount();
+};
+
+// Move-only owner of one registered resource. An empty handle means the load or creation failed;
+// failed sound and music loads are reported, textures are left to the caller since a missing
+// render target has a fallback.
+template <typename T>
+class ResourceHandle
+{
+public:
+    ResourceHandle() {}
+    ResourceHandle(ResourceRegistry *owner, int resourceId, T *pointer) : registry(owner), id(resourceId), resource(pointer) {}
+    ResourceHandle(ResourceHandle &&other) { *this = move(other); }
+    ResourceHandle(const ResourceHandle &) = delete;
+    ResourceHandle &operator=(const ResourceHandle &) = delete;
+    ~ResourceHandle() { reset(); }
+
+    ResourceHandle &operator=(ResourceHandle &&other)
     {
-        cerr << "Failed to load background music! SDL_mixer Error: " << Mix_GetError() << endl;
+        if (this != &other)
+        {
+            reset();
+            registry = other.registry;
+            id = other.id;
+            resource = other.resource;
+            other.registry = nullptr;
+            other.id = -1;
+            other.resource = nullptr;
+        }
+        return *this;
+    }
+
+    T *get() const { return resource; }
+    explicit operator bool() const { return resource != nullptr; }
+    void reset();
+
+private:
+    ResourceRegistry *registry = nullptr;
+    int id = -1;
+    T *resource = nullptr;
+};
+
+template <typename T>
+void ResourceHandle<T>::reset()
+{
+    if (registry && id >= 0)
+        registry->release(id);
+    registry = nullptr;
+    id = -1;
+    resource = nullptr;
+}
+
+bool ResourceRegistry::init(RenderBackend *registryBackend)
+{
+    backend = registryBackend;
+    lock = SDL_CreateMutex();
+    return lock != nullptr;
+}
+
+int ResourceRegistry::add(ResourceKind kind, const char *name, void *resource, size_t size)
+{
+    SDL_LockMutex(lock);
+    int id = (int)entries.size();
+    entries.push_back({kind, name, resource, size, true});
+    bytes[kind] += size;
+    counts[kind]++;
+    total += size;
+    peak = max(peak, total);
+    bool crossed = budget > 0 && total > budget && !overBudget;
+    overBudget = budget > 0 && total > budget;
+    SDL_UnlockMutex(lock);
+    if (crossed)
+    {
+        cerr << "[resources] over budget: " << total / 1024 << " KB of " << budget / 1024 << " KB after loading " << name << endl;
+    }
+    return id;
+}
+
+TextureHandle ResourceRegistry::texture(const char *name, RenderTexture *texture)
+{
+    if (!texture)
+        return TextureHandle();
+    size_t size = (size_t)texture->w * texture->h * SDL_BYTESPERPIXEL(backend->textureFormat());
+    return TextureHandle(this, add(RESOURCE_TEXTURE, name, texture, size), texture);
+}
+
+SoundHandle ResourceRegistry::sound(const char *name, Mix_Chunk *chunk)
+{
+    if (!chunk)
+    {
+        cerr << "Failed to load sound " << name << "! SDL_mixer Error: " << Mix_GetError() << endl;
+        return SoundHandle();
+    }
+    return SoundHandle(this, add(RESOURCE_SOUND, name, chunk, chunk->alen), chunk);
+}
+
+MusicHandle ResourceRegistry::music(const char *name, Mix_Music *music, size_t size)
+{
+    if (!music)
+    {
+        cerr << "Failed to load music " << name << "! SDL_mixer Error: " << Mix_GetError() << endl;
+        return MusicHandle();
+    }
+    return MusicHandle(this, add(RESOURCE_MUSIC, name, music, size), music);
+}
+
+// The file stays owned by the caller's object; releasing the handle unmaps it.
+MappingHandle ResourceRegistry::mapping(const char *name, AssetPack *file, size_t size)
+{
+    return MappingHandle(this, add(RESOURCE_MAPPING, name, file, size), file);
+}
+
+// Frees the resource with the call that matches its kind; only the main thread releases.
+void ResourceRegistry::release(int id)
+{
+    SDL_LockMutex(lock);
+    Entry entry = entries[id];
+    if (entry.alive)
+    {
+        entries[id].alive = false;
+        bytes[entry.kind] -= entry.bytes;
+        counts[entry.kind]--;
+        total -= entry.bytes;
+        overBudget = budget > 0 && total > budget;
+    }
+    SDL_UnlockMutex(lock);
+    if (!entry.alive)
+        return;
+    if (entry.kind == RESOURCE_TEXTURE)
+        backend->destroyTexture(static_cast<RenderTexture *>(entry.resource));
+    else if (entry.kind == RESOURCE_SOUND)
+        Mix_FreeChunk(static_cast<Mix_Chunk *>(entry.resource));
+    else if (entry.kind == RESOURCE_MUSIC)
+        Mix_FreeMusic(static_cast<Mix_Music *>(entry.resource));
+    else
+        static_cast<AssetPack *>(entry.resource)->close();
+}
+
+int ResourceRegistry::liveCount()
+{
+    int live = 0;
+    for (int i = 0; i < RESOURCE_KIND_COUNT; ++i)
+        live += counts[i];
+    return live;
+}
+
+void ResourceRegistry::report(const char *when)
+{
+    SDL_LockMutex(lock);
+    cout << "[resources] " << when << ":";
+    for (int i = 0; i < RESOURCE_KIND_COUNT; ++i)
+    {
+        cout << "  " << resourceKindNames[i] << " " << counts[i] << " (" << bytes[i] / 1024 << " KB)";
+    }
+    cout << "  total " << total / 1024 << " KB, peak " << peak / 1024 << " KB";
+    if (budget > 0)
+    {
+        cout << " of " << budget / 1024 << " KB budget" << (peak > budget ? " (OVER)" : "");
+    }
+    cout << endl;
+    SDL_UnlockMutex(lock);
+}
+
+// Called between runs: everything a run needs exists from the start, so growth is a leak.
+void ResourceRegistry::checkGrowth()
+{
+    SDL_LockMutex(lock);
+    int live = liveCount();
+    if (lastCount >= 0 && (live > lastCount || total > lastBytes))
+    {
+        cerr << "[resources] " << live - lastCount << " more resources and " << ((long long)total - (long long)lastBytes) / 1024
+             << " KB more alive than after the previous run" << endl;
+    }
+    lastCount = live;
+    lastBytes = total;
+    SDL_UnlockMutex(lock);
+}
+
+void ResourceRegistry::checkLeaks()
+{
+    for (const Entry &entry : entries)
+    {
+        if (entry.alive)
+            cerr << "[resources] leaked " << entry.name << " (" << entry.bytes / 1024 << " KB)" << endl;
+    }
+}
+
+void ResourceRegistry::destroy()
+{
+    SDL_DestroyMutex(lock);
+    lock = nullptr;
+}
+
+// ============================= SPRITE ATLAS ============================= //
+// Packs every sprite into a single texture so all sprite draws share one texture and
+// can later be batched. Sprites are looked up by id and drawn with their sub-rectangle.
+enum SpriteId
+{
+    SPRITE_CAR_RED,
+    SPRITE_CAR_BLUE,
+    SPRITE_CIRCLE_RED,
+    SPRITE_BOX_RED,
+    SPRITE_CIRCLE_BLUE,
+    SPRITE_BOX_BLUE,
+    SPRITE_ICON,
+    SPRITE_PARTICLE,
+    SPRITE_COUNT
+};
+
+const char *spritePaths[SPRITE_COUNT] = {
+    "assets/car-red.png",
+    "assets/car-blue.png",
+    "assets/circle-red.png",
+    "assets/box-red.png",
+    "assets/circle-blue.png",
+    "assets/box-blue.png",
+    "assets/icon.png",
+    nullptr}; // generated at load time
+
+// Size of the particle dot in the atlas; each particle scales it to its own size.
+#define PARTICLE_SIZE 8
+
+// On-screen size of every sprite; the PNGs are far larger and are resampled down to this
+// once at load time. A size of 0 keeps the source size (the icon is never drawn in game).
+const int spriteSizes[SPRITE_COUNT][2] = {
+    {CAR_WIDTH, CAR_HEIGHT},
+    {CAR_WIDTH, CAR_HEIGHT},
+    {OBSTACLE_SIZE, OBSTACLE_SIZE},
+    {OBSTACLE_SIZE, OBSTACLE_SIZE},
+    {OBSTACLE_SIZE, OBSTACLE_SIZE},
+    {OBSTACLE_SIZE, OBSTACLE_SIZE},
+    {0, 0},
+    {PARTICLE_SIZE, PARTICLE_SIZE}};
+
+// Transparent gap around every sprite so filtering never samples a neighbour.
+#define ATLAS_PADDING 2
+
+// Area-averaging resampler. Each destination pixel is the coverage-weighted mean of the source
+// pixels under it, with colour weighted by alpha so transparent edges do not darken the sprite.
+SDL_Surface *resampleSurface(SDL_Surface *source, int width, int height)
+{
+    SDL_Surface *src = SDL_ConvertSurfaceFormat(source, SDL_PIXELFORMAT_RGBA32, 0);
+    SDL_Surface *dst = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_RGBA32);
+    if (!src || !dst)
+    {
+        SDL_FreeSurface(src);
+        SDL_FreeSurface(dst);
+        return nullptr;
+    }
+
+    double scaleX = (double)src->w / width;
+    double scaleY = (double)src->h / height;
+    for (int dy = 0; dy < height; ++dy)
+    {
+        double y0 = dy * scaleY, y1 = min((dy + 1) * scaleY, (double)src->h);
+        Uint8 *outRow = (Uint8 *)dst->pixels + dy * dst->pitch;
+        for (int dx = 0; dx < width; ++dx)
+        {
+            double x0 = dx * scaleX, x1 = min((dx + 1) * scaleX, (double)src->w);
+            double r = 0, g = 0, b = 0, a = 0, area = 0;
+            for (int sy = (int)y0; sy < y1; ++sy)
+            {
+                double wy = min(y1, sy + 1.0) - max(y0, (double)sy);
+                const Uint8 *inRow = (const Uint8 *)src->pixels + sy * src->pitch;
+                for (int sx = (int)x0; sx < x1; ++sx)
+                {
+                    double weight = wy * (min(x1, sx + 1.0) - max(x0, (double)sx));
+                    const Uint8 *p = inRow + sx * 4;
+                    double alpha = p[3] * weight;
+                    r += p[0] * alpha;
+                    g += p[1] * alpha;
+                    b += p[2] * alpha;
+                    a += alpha;
+                    area += weight;
+                }
+            }
+            Uint8 *out = outRow + dx * 4;
+            out[0] = a > 0 ? (Uint8)(r / a + 0.5) : 0;
+            out[1] = a > 0 ? (Uint8)(g / a + 0.5) : 0;
+            out[2] = a > 0 ? (Uint8)(b / a + 0.5) : 0;
+            out[3] = area > 0 ? (Uint8)(a / area + 0.5) : 0;
+        }
+    }
+    SDL_FreeSurface(src);
+    return dst;
+}
+
+// Cars tilt up to CAR_MAX_TILT degrees while changing lanes. Every whole-degree tilt is
+// rendered into the atlas at load time, so drawing a tilted car is a plain unrotated blit.
+#define TILT_VARIANTS (CAR_MAX_TILT + 1)
+#define TILTED_SPRITE_COUNT 2
+
+const SpriteId tiltedSprites[TILTED_SPRITE_COUNT] = {SPRITE_CAR_RED, SPRITE_CAR_BLUE};
+
+// Rotates a sprite clockwise by the given angle into a surface the size of its bounding box,
+// sampling bilinearly with colour weighted by alpha, like resampleSurface.
+SDL_Surface *rotateSurface(SDL_Surface *source, double degrees)
+{
+    double c = cos(degrees * M_PI / 180), s = sin(degrees * M_PI / 180);
+    int w = source->w, h = source->h;
+    int boxWidth = (int)ceil(fabs(w * c) + fabs(h * s) - 1e-6);
+    int boxHeight = (int)ceil(fabs(w * s) + fabs(h * c) - 1e-6);
+    SDL_Surface *dst = SDL_CreateRGBSurfaceWithFormat(0, boxWidth, boxHeight, 32, SDL_PIXELFORMAT_RGBA32);
+    if (!dst)
+        return nullptr;
+
+    for (int y = 0; y < boxHeight; ++y)
+    {
+        Uint8 *outRow = (Uint8 *)dst->pixels + y * dst->pitch;
+        for (int x = 0; x < boxWidth; ++x)
+        {
+            // Undo the rotation around the centre to find where this pixel comes from.
+            double ox = x + 0.5 - boxWidth * 0.5, oy = y + 0.5 - boxHeight * 0.5;
+            double u = ox * c + oy * s + w * 0.5 - 0.5;
+            double v = -ox * s + oy * c + h * 0.5 - 0.5;
+            int u0 = (int)floor(u), v0 = (int)floor(v);
+            double fu = u - u0, fv = v - v0;
+            double r = 0, g = 0, b = 0, a = 0;
+            for (int tap = 0; tap < 4; ++tap)
+            {
+                int tu = u0 + (tap & 1), tv = v0 + (tap >> 1);
+                if (tu < 0 || tv < 0 || tu >= w || tv >= h)
+                    continue;
+                const Uint8 *p = (const Uint8 *)source->pixels + tv * source->pitch + tu * 4;
+                double alpha = p[3] * ((tap & 1) ? fu : 1 - fu) * ((tap >> 1) ? fv : 1 - fv);
+                r += p[0] * alpha;
+                g += p[1] * alpha;
+                b += p[2] * alpha;
+                a += alpha;
+            }
+            Uint8 *out = outRow + x * 4;
+            out[0] = a > 0 ? (Uint8)(r / a + 0.5) : 0;
+            out[1] = a > 0 ? (Uint8)(g / a + 0.5) : 0;
+            out[2] = a > 0 ? (Uint8)(b / a + 0.5) : 0;
+            out[3] = (Uint8)(a + 0.5);
+        }
+    }
+    return dst;
+}
+
+class SpriteAtlas
+{
+public:
+    TextureHandle texture;
+    SDL_Rect rects[SPRITE_COUNT];
+
+    bool build(RenderBackend *backend, ResourceRegistry &resources, SDL_Surface *sources[SPRITE_COUNT], float scale);
+    void tilted(int sprite, double angle, const SDL_Rect &dst, SDL_Rect &variantSrc, SDL_Rect &variantDst);
+    void destroy() { texture.reset(); }
+
+private:
+    // Atlas rectangle and on-screen size of each pre-rotated variant; variant 0 is the sprite itself.
+    SDL_Rect tiltRects[TILTED_SPRITE_COUNT][TILT_VARIANTS];
+    SDL_Point tiltSizes[TILTED_SPRITE_COUNT][TILT_VARIANTS];
+};
+
+// Resamples every sprite to its on-screen size times the display scale, renders the car tilts,
+// then packs everything with a shelf packer: tallest first, left to right, starting a new row
+// when the current one is full. The atlas is sized to a power of two that fits them.
+bool SpriteAtlas::build(RenderBackend *backend, ResourceRegistry &resources, SDL_Surface *sources[SPRITE_COUNT], float scale)
+{
+    vector<SDL_Surface *> surfaces;
+    vector<SDL_Rect *> places;
+    int atlasWidth = 1;
+    for (int i = 0; i < SPRITE_COUNT; ++i)
+    {
+        SDL_Surface *surface = nullptr;
+        if (sources[i] && spriteSizes[i][0] > 0)
+            surface = resampleSurface(sources[i], (int)ceil(spriteSizes[i][0] * scale), (int)ceil(spriteSizes[i][1] * scale));
+        else if (sources[i])
+            surface = SDL_ConvertSurfaceFormat(sources[i], SDL_PIXELFORMAT_RGBA32, 0);
+        if (!surface)
+        {
+            cerr << "Missing sprite " << (spritePaths[i] ? spritePaths[i] : "(generated)") << endl;
+            for (SDL_Surface *loaded : surfaces)
+                SDL_FreeSurface(loaded);
+            return false;
+        }
+        surfaces.push_back(surface);
+        places.push_back(&rects[i]);
+    }
+    for (int t = 0; t < TILTED_SPRITE_COUNT; ++t)
+    {
+        SpriteId id = tiltedSprites[t];
+        tiltSizes[t][0] = {spriteSizes[id][0], spriteSizes[id][1]};
+        for (int degrees = 1; degrees < TILT_VARIANTS; ++degrees)
+        {
+            SDL_Surface *rotated = rotateSurface(surfaces[id], degrees);
+            if (!rotated)
+            {
+                tiltSizes[t][degrees] = {0, 0};
+                continue;
+            }
+            tiltSizes[t][degrees] = {(int)lround(rotated->w / scale), (int)lround(rotated->h / scale)};
+            surfaces.push_back(rotated);
+            places.push_back(&tiltRects[t][degrees]);
+        }
+    }
+
+    vector<int> order;
+    for (size_t i = 0; i < surfaces.size(); ++i)
+    {
+        order.push_back(i);
+        while (atlasWidth < surfaces[i]->w + 2 * ATLAS_PADDING)
+            atlasWidth *= 2;
+    }
+    atlasWidth = max(atlasWidth, 256);
+    sort(order.begin(), order.end(), [&](int a, int b)
+         { return surfaces[a]->h > surfaces[b]->h; });
+
+    int x = 0, y = 0, rowHeight = 0;
+    for (int id : order)
+    {
+        int w = surfaces[id]->w + 2 * ATLAS_PADDING;
+        int h = surfaces[id]->h + 2 * ATLAS_PADDING;
+        if (x + w > atlasWidth)
+        {
+            x = 0;
+            y += rowHeight;
+            rowHeight = 0;
+        }
+        *places[id] = {x + ATLAS_PADDING, y + ATLAS_PADDING, surfaces[id]->w, surfaces[id]->h};
+        x += w;
+        rowHeight = max(rowHeight, h);
+    }
+    int atlasHeight = 1;
+    while (atlasHeight < y + rowHeight)
+        atlasHeight *= 2;
+    for (int t = 0; t < TILTED_SPRITE_COUNT; ++t)
+    {
+        tiltRects[t][0] = rects[tiltedSprites[t]];
+        // A variant that could not be rotated falls back to the upright sprite.
+        for (int degrees = 1; degrees < TILT_VARIANTS; ++degrees)
+        {
+            if (tiltSizes[t][degrees].x == 0)
+            {
+                tiltRects[t][degrees] = tiltRects[t][0];
+                tiltSizes[t][degrees] = tiltSizes[t][0];
+            }
+        }
+    }
+
+    int maxSize = backend->maxTextureSize();
+    if (maxSize > 0 && (atlasWidth > maxSize || atlasHeight > maxSize))
+    {
+        cerr << "Sprite atlas " << atlasWidth << "x" << atlasHeight << " exceeds the renderer's texture limit" << endl;
+        for (SDL_Surface *surface : surfaces)
+            SDL_FreeSurface(surface);
+        return false;
+    }
+
+    // Build the atlas directly in the backend's native format so the upload is a plain copy.
+    Uint32 format = backend->textureFormat();
+    SDL_Surface *atlasSurface = SDL_CreateRGBSurfaceWithFormat(0, atlasWidth, atlasHeight, 32, format);
+    if (atlasSurface)
+    {
+        SDL_FillRect(atlasSurface, NULL, SDL_MapRGBA(atlasSurface->format, 0, 0, 0, 0));
+        for (size_t i = 0; i < surfaces.size(); ++i)
+        {
+            // Copy the pixels as they are, alpha included, instead of blending onto the empty atlas.
+            SDL_SetSurfaceBlendMode(surfaces[i], SDL_BLENDMODE_NONE);
+            SDL_BlitSurface(surfaces[i], NULL, atlasSurface, places[i]);
+        }
+        texture = resources.texture("sprite atlas", backend->createTexture(atlasSurface));
+        SDL_FreeSurface(atlasSurface);
+    }
+    for (SDL_Surface *surface : surfaces)
+    {
+        SDL_FreeSurface(surface);
+    }
+
+    if (!texture)
+    {
+        cerr << "Failed to create sprite atlas! SDL Error: " << SDL_GetError() << endl;
+        return false;
+    }
+    return true;
+}
+
+// Picks the pre-rotated variant nearest to angle and a screen rectangle for it centred on dst.
+// Sprites without variants are returned unchanged.
+void SpriteAtlas::tilted(int sprite, double angle, const SDL_Rect &dst, SDL_Rect &variantSrc, SDL_Rect &variantDst)
+{
+    variantSrc = rects[sprite];
+    variantDst = dst;
+    for (int t = 0; t < TILTED_SPRITE_COUNT; ++t)
+    {
+        if (tiltedSprites[t] != sprite)
+            continue;
+        int degrees = min(CAR_MAX_TILT, max(0, (int)lround(angle)));
+        SDL_Point size = tiltSizes[t][degrees];
+        variantSrc = tiltRects[t][degrees];
+        variantDst = {dst.x + (dst.w - size.x) / 2, dst.y + (dst.h - size.y) / 2, size.x, size.y};
+    }
+}
+
+// ============================= SPRITE BATCH ============================= //
+// Collects every sprite quad of a frame into a preallocated array and hands them to the backend
+// in one call, so the number of draw calls does not grow with the number of obstacles.
+#define SPRITE_BATCH_CAPACITY 512
+
+class SpriteBatch
+{
+public:
+    void begin(RenderBackend *batchBackend, RenderTexture *batchTexture);
+    void add(const SDL_Rect &src, const SDL_Rect &dst, SDL_Color color = {255, 255, 255, 255});
+    void flush();
+
+private:
+    RenderBackend *backend = nullptr;
+    RenderTexture *texture = nullptr;
+    int quadCount = 0;
+    SpriteQuad quads[SPRITE_BATCH_CAPACITY];
+};
+
+void SpriteBatch::begin(RenderBackend *batchBackend, RenderTexture *batchTexture)
+{
+    backend = batchBackend;
+    texture = batchTexture;
+    quadCount = 0;
+}
+
+// Rotation matches SDL_RenderCopyEx: degrees clockwise around the centre of dst. The colour
+// tints the sprite, the same as SDL_SetTextureColorMod and SDL_SetTextureAlphaMod.
+void SpriteBatch::add(const SDL_Rect &src, const SDL_Rect &dst, SDL_Color color)
+{
+    if (quadCount == SPRITE_BATCH_CAPACITY)
+    {
+        flush();
+    }
+    quads[quadCount++] = {src, dst, color};
+}
+
+void SpriteBatch::flush()
+{
+    if (quadCount > 0)
+    {
+        backend->drawSprites(texture, quads, quadCount);
+    }
+    quadCount = 0;
+}
+
+// ============================= BITMAP FONT ============================= //
+// All text is drawn as quads from one glyph atlas holding every size the game uses (see
+// fontbake.h), so the menu, death screen and live score cost no rasterizing or texture uploads.
+// The kiosk build (BAKED_FONT) takes the atlas from baked_font.h, generated at build time, and
+// does not use SDL_ttf at all; other builds bake it from the TTF while loading.
+enum FontId
+{
+    FONT_TITLE,
+    FONT_MENU,
+    FONT_COUNT
+};
+
+const int fontSizes[FONT_COUNT] = {24, 20};
+
+struct TextLabel
+{
+    const char *text = "";
+    FontId font = FONT_TITLE;
+    int w = 0, h = 0;
+};
+
+class BitmapFont
+{
+public:
+    bool init(RenderBackend *fontBackend, ResourceRegistry &resources, const BakedFontAtlas &atlas);
+    TextLabel makeLabel(FontId font, const char *text);
+    int width(FontId font, const char *text);
+    void draw(SpriteBatch &batch, FontId font, const char *text, int x, int y);
+    void drawLabel(SpriteBatch &batch, const TextLabel &label, int x, int y);
+    int numberWidth(int value);
+    void drawNumber(SpriteBatch &batch, int value, int x, int y);
+    void destroy();
+
+private:
+    RenderBackend *backend = nullptr;
+    TextureHandle texture;
+    BakedFontSize sizes[FONT_COUNT];
+
+    const BakedGlyph *glyph(FontId font, char c);
+};
+
+// Picks the baked sizes the game uses and uploads the coverage as white glyphs with alpha.
+bool BitmapFont::init(RenderBackend *fontBackend, ResourceRegistry &resources, const BakedFontAtlas &atlas)
+{
+    backend = fontBackend;
+    for (int f = 0; f < FONT_COUNT; ++f)
+    {
+        int found = -1;
+        for (int i = 0; i < atlas.sizeCount; ++i)
+        {
+            if (atlas.sizes[i].size == fontSizes[f])
+                found = i;
+        }
+        if (found < 0)
+        {
+            cerr << "The baked font has no glyphs at size " << fontSizes[f] << endl;
+            return false;
+        }
+        sizes[f] = atlas.sizes[found];
+    }
+    if (atlas.height <= 0 || atlas.coverage.size() < (size_t)atlas.width * atlas.height)
+        return false;
+
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, atlas.width, atlas.height, 32, SDL_PIXELFORMAT_RGBA32);
+    if (!surface)
+        return false;
+    for (int y = 0; y < atlas.height; ++y)
+    {
+        Uint32 *row = (Uint32 *)((Uint8 *)surface->pixels + y * surface->pitch);
+        for (int x = 0; x < atlas.width; ++x)
+            row[x] = SDL_MapRGBA(surface->format, 255, 255, 255, atlas.coverage[(size_t)y * atlas.width + x]);
+    }
+    texture = resources.texture("glyph atlas", backend->createTexture(surface));
+    SDL_FreeSurface(surface);
+    return (bool)texture;
+}
+
+const BakedGlyph *BitmapFont::glyph(FontId font, char c)
+{
+    int index = (unsigned char)c - FONT_FIRST_CHAR;
+    if (index < 0 || index >= FONT_CHAR_COUNT)
+        index = '?' - FONT_FIRST_CHAR;
+    return &sizes[font].glyphs[index];
+}
+
+TextLabel BitmapFont::makeLabel(FontId font, const char *text)
+{
+    TextLabel label;
+    label.text = text;
+    label.font = font;
+    label.w = width(font, text);
+    label.h = sizes[font].height;
+    return label;
+}
+
+int BitmapFont::width(FontId font, const char *text)
+{
+    int w = 0;
+    for (const char *c = text; *c; ++c)
+        w += glyph(font, *c)->advance;
+    return w;
+}
+
+void BitmapFont::draw(SpriteBatch &batch, FontId font, const char *text, int x, int y)
+{
+    if (!texture)
+        return;
+    batch.begin(backend, texture.get());
+    for (const char *c = text; *c; ++c)
+    {
+        const BakedGlyph *g = glyph(font, *c);
+        if (g->w > 0)
+        {
+            SDL_Rect src = {g->x, g->y, g->w, g->h};
+            SDL_Rect dst = {x + g->offsetX, y + g->offsetY, g->w, g->h};
+            batch.add(src, dst);
+        }
+        x += g->advance;
+    }
+    batch.flush();
+}
+
+void BitmapFont::drawLabel(SpriteBatch &batch, const TextLabel &label, int x, int y)
+{
+    draw(batch, label.font, label.text, x, y);
+}
+
+// Numbers use the title font, like the score and highscore labels they follow.
+int BitmapFont::numberWidth(int value)
+{
+    char digits[12];
+    snprintf(digits, sizeof(digits), "%d", max(value, 0));
+    return width(FONT_TITLE, digits);
+}
+
+void BitmapFont::drawNumber(SpriteBatch &batch, int value, int x, int y)
+{
+    char digits[12];
+    snprintf(digits, sizeof(digits), "%d", max(value, 0));
+    draw(batch, FONT_TITLE, digits, x, y);
+}
+
+void BitmapFont::destroy()
+{
+    texture.reset();
+}
+
+// ============================= PARTICLES ============================= //
+// Sparks, crash debris and exhaust trails in one fixed pool of structure-of-arrays particles,
+// with per-frame spawn and draw budgets so a burst can never blow the frame time.
+#define PARTICLE_CAPACITY 4096
+#define PARTICLE_SPAWN_BUDGET 256
+#define PARTICLE_DRAW_BUDGET 1024
+#define PARTICLE_DRAG 0.96f
+
+// The particle sprite is generated instead of loaded: a white dot whose alpha fades
+// smoothly from the centre to the edge. The atlas resamples it to PARTICLE_SIZE.
+SDL_Surface *makeParticleSurface()
+{
+    const int size = 32;
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, size, size, 32, SDL_PIXELFORMAT_RGBA32);
+    if (!surface)
+        return nullptr;
+    for (int y = 0; y < size; ++y)
+    {
+        Uint8 *row = (Uint8 *)surface->pixels + y * surface->pitch;
+        for (int x = 0; x < size; ++x)
+        {
+            double dx = (x + 0.5) / size * 2 - 1, dy = (y + 0.5) / size * 2 - 1;
+            double falloff = max(0.0, 1 - sqrt(dx * dx + dy * dy));
+            row[x * 4 + 0] = row[x * 4 + 1] = row[x * 4 + 2] = 255;
+            row[x * 4 + 3] = (Uint8)(255 * falloff * falloff + 0.5);
+        }
+    }
+    return surface;
+}
+
+class ParticleSystem
+{
+public:
+    int spawnBudget = PARTICLE_SPAWN_BUDGET;
+    int drawBudget = PARTICLE_DRAW_BUDGET;
+
+    void init(int poolCapacity);
+    void clear() { count = 0; }
+    int live() { return count; }
+    bool spawn(float px, float py, float pvx, float pvy, float pgravity, float plife, float psize, SDL_Color pcolor);
+    void burst(float px, float py, int amount, float speed, float pgravity, float plife, float psize, SDL_Color pcolor);
+    void update();
+    void draw(SpriteBatch &batch, const SDL_Rect &sprite);
+
+private:
+    int capacity = 0;
+    int count = 0;
+    int spawnedThisFrame = 0;
+    vector<float> x, y, vx, vy, gravity, life, maxLife, size;
+    vector<SDL_Color> color;
+    mt19937 rng;
+};
+
+void ParticleSystem::init(int poolCapacity)
+{
+    capacity = poolCapacity;
+    count = 0;
+    for (vector<float> *field : {&x, &y, &vx, &vy, &gravity, &life, &maxLife, &size})
+    {
+        field->assign(capacity, 0.0f);
+    }
+    color.assign(capacity, SDL_Color{255, 255, 255, 255});
+}
+
+// Adds one particle; returns false when the pool or this frame's spawn budget is exhausted.
+bool ParticleSystem::spawn(float px, float py, float pvx, float pvy, float pgravity, float plife, float psize, SDL_Color pcolor)
+{
+    if (count == capacity || spawnedThisFrame == spawnBudget)
+        return false;
+    int i = count++;
+    spawnedThisFrame++;
+    x[i] = px;
+    y[i] = py;
+    vx[i] = pvx;
+    vy[i] = pvy;
+    gravity[i] = pgravity;
+    life[i] = maxLife[i] = plife;
+    size[i] = psize;
+    color[i] = pcolor;
+    return true;
+}
+
+// Throws particles out from a point in random directions at up to speed pixels per tick.
+void ParticleSystem::burst(float px, float py, int amount, float speed, float pgravity, float plife, float psize, SDL_Color pcolor)
+{
+    uniform_real_distribution<float> angle(0, 2 * (float)M_PI), fraction(0.3f, 1.0f);
+    for (int i = 0; i < amount; ++i)
+    {
+        float a = angle(rng), v = speed * fraction(rng);
+        if (!spawn(px, py, v * cos(a), v * sin(a), pgravity, plife * fraction(rng), psize, pcolor))
+            break;
+    }
+}
+
+// Advances every particle by one tick, then removes the ones that expired or left the screen.
+void ParticleSystem::update()
+{
+    spawnedThisFrame = 0;
+    int i = 0;
+#ifdef __SSE2__
+    const __m128 drag = _mm_set1_ps(PARTICLE_DRAG);
+    const __m128 one = _mm_set1_ps(1.0f);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 velocityX = _mm_mul_ps(_mm_loadu_ps(&vx[i]), drag);
+        __m128 velocityY = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&vy[i]), drag), _mm_loadu_ps(&gravity[i]));
+        _mm_storeu_ps(&vx[i], velocityX);
+        _mm_storeu_ps(&vy[i], velocityY);
+        _mm_storeu_ps(&x[i], _mm_add_ps(_mm_loadu_ps(&x[i]), velocityX));
+        _mm_storeu_ps(&y[i], _mm_add_ps(_mm_loadu_ps(&y[i]), velocityY));
+        _mm_storeu_ps(&life[i], _mm_sub_ps(_mm_loadu_ps(&life[i]), one));
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        vx[i] *= PARTICLE_DRAG;
+        vy[i] = vy[i] * PARTICLE_DRAG + gravity[i];
+        x[i] += vx[i];
+        y[i] += vy[i];
+        life[i] -= 1.0f;
+    }
+
+    for (i = 0; i < count;)
+    {
+        if (life[i] > 0 && y[i] < SCREEN_HEIGHT + size[i] && y[i] > -size[i] && x[i] > -size[i] && x[i] < SCREEN_WIDTH + size[i])
+        {
+            ++i;
+            continue;
+        }
+        int last = --count;
+        x[i] = x[last];
+        y[i] = y[last];
+        vx[i] = vx[last];
+        vy[i] = vy[last];
+        gravity[i] = gravity[last];
+        life[i] = life[last];
+        maxLife[i] = maxLife[last];
+        size[i] = size[last];
+        color[i] = color[last];
+    }
+}
+
+// Particles shrink and fade out over their life.
+void ParticleSystem::draw(SpriteBatch &batch, const SDL_Rect &sprite)
+{
+    int drawn = min(count, drawBudget);
+    for (int i = 0; i < drawn; ++i)
+    {
+        float fade = life[i] / maxLife[i];
+        int s = max(1, (int)(size[i] * (0.5f + 0.5f * fade) + 0.5f));
+        SDL_Rect dst = {(int)x[i] - s / 2, (int)y[i] - s / 2, s, s};
+        SDL_Color tint = color[i];
+        tint.a = (Uint8)(tint.a * fade);
+        batch.add(sprite, dst, tint);
+    }
+}
+
+// ============================= AUDIO MIXER ============================= //
+// Sound effects are mixed by our own post-mix callback on a fixed pool of voices, fed by a
+// lock-free command queue and scheduled on the output frame matching their simulation tick.
+#define AUDIO_BUFFER_MIN 256
+#define AUDIO_BUFFER_MAX 512 // underrun tuning stops here; larger needs --audio-buffer
+#define AUDIO_CLEAN_SESSIONS 3 // clean sessions in a row before a grown buffer is halved
+#define AUDIO_LATE_FACTOR 2
+#define AUDIO_UNDERRUN_LIMIT 3
+#define AUDIO_CHECK_INTERVAL 5000
+#define AUDIO_CLOCK_GRANULE 64
+#define AUDIO_SCHEDULE_MAX_LEAD 4
+#define SFX_QUEUE_SIZE 64
+#define SFX_VOICES 8
+#define SFX_MERGE_MS 20
+
+enum SfxPriority
+{
+    SFX_LOW,    // pickups and misses, which come in bursts
+    SFX_HIGH    // the crash
+};
+
+struct SfxCommand
+{
+    const Mix_Chunk *chunk;
+    Uint64 frame;
+    Uint64 issued;
+    int priority;
+};
+
+// Same shape as the steering queue: one producer, one consumer, indices published atomically.
+class SfxQueue
+{
+public:
+    SfxQueue() { clear(); }
+    // Only while neither side is running.
+    void clear()
+    {
+        SDL_AtomicSet(&head, 0);
+        SDL_AtomicSet(&tail, 0);
+    }
+    bool push(const SfxCommand &command)
+    {
+        int write = SDL_AtomicGet(&tail);
+        if (write - SDL_AtomicGet(&head) == SFX_QUEUE_SIZE)
+            return false;
+        entries[write % SFX_QUEUE_SIZE] = command;
+        SDL_AtomicSet(&tail, write + 1);
+        return true;
+    }
+    bool pop(SfxCommand &command)
+    {
+        int read = SDL_AtomicGet(&head);
+        if (read == SDL_AtomicGet(&tail))
+            return false;
+        command = entries[read % SFX_QUEUE_SIZE];
+        SDL_AtomicSet(&head, read + 1);
+        return true;
+    }
+
+private:
+    SfxCommand entries[SFX_QUEUE_SIZE];
+    SDL_atomic_t head, tail;
+};
+
+struct SfxVoice
+{
+    const Mix_Chunk *chunk = nullptr;
+    Uint64 startFrame = 0;
+    Uint32 position = 0; // in samples
+    Uint64 issued = 0;
+    int priority = SFX_LOW;
+};
+
+class AudioMixer
+{
+public:
+    int bufferFrames = 0;
+
+    void start(int frames);
+    void stop();
+    bool play(const Mix_Chunk *chunk, int tick, int priority);
+    int takeUnderruns() { return SDL_AtomicSet(&underruns, 0); }
+    void report();
+
+private:
+    int frequency = PACK_AUDIO_FREQUENCY;
+    int channels = PACK_AUDIO_CHANNELS;
+    bool mixable = false;
+    double bufferMs = 0;
+    SfxQueue queue;
+    SDL_atomic_t clock;
+    SDL_atomic_t underruns;
+
+    // Producer side.
+    bool anchored = false;
+    int anchorTick = 0;
+    Uint64 anchorFrame = 0;
+    int dropped = 0;
+
+    // Audio thread side.
+    Uint64 frameClock = 0;
+    Uint64 lastCallback = 0;
+    SfxVoice voices[SFX_VOICES];
+    int totalUnderruns = 0, late = 0, merged = 0, stolen = 0, voicesFull = 0;
+    double latencySum = 0, latencyMax = 0;
+    int latencyCount = 0;
+
+    static void postMix(void *data, Uint8 *stream, int len);
+    void startVoice(const SfxCommand &command);
+    void mixVoice(SfxVoice &voice, Sint16 *out, int frames, Uint64 now);
+};
+
+void AudioMixer::start(int frames)
+{
+    Uint16 format = AUDIO_S16SYS;
+    Mix_QuerySpec(&frequency, &format, &channels);
+    // Chunks are loaded in the device format, so they mix sample for sample; only 16-bit is handled.
+    mixable = format == AUDIO_S16SYS && channels > 0;
+    if (!mixable)
+    {
+        cerr << "Audio opened as format " << format << "; sound effects are disabled" << endl;
+    }
+    bufferFrames = frames;
+    bufferMs = 1000.0 * frames / frequency;
+    queue.clear();
+    SDL_AtomicSet(&clock, 0);
+    SDL_AtomicSet(&underruns, 0);
+    anchored = false;
+    frameClock = 0;
+    lastCallback = 0;
+    for (SfxVoice &voice : voices)
+        voice = SfxVoice();
+    Mix_SetPostMix(postMix, this);
+}
+
+// The mixer calls nothing of ours once the hook is gone; voices still playing are cut.
+void AudioMixer::stop()
+{
+    Mix_SetPostMix(NULL, NULL);
+    for (SfxVoice &voice : voices)
+        voice = SfxVoice();
+}
+
+// Schedules chunk for the output frame that corresponds to tick. Never blocks; when the audio
+// thread has fallen a whole queue behind the sound is dropped.
+bool AudioMixer::play(const Mix_Chunk *chunk, int tick, int priority)
+{
+    if (!chunk || bufferFrames == 0)
+        return false;
+    Uint64 mixed = (Uint64)(Uint32)SDL_AtomicGet(&clock) * AUDIO_CLOCK_GRANULE;
+    bool reanchor = !anchored || tick < anchorTick;
+    Uint64 frame = reanchor ? 0 : anchorFrame + (Uint64)(tick - anchorTick) * frequency / TICKS_PER_SECOND;
+    if (reanchor || frame < mixed || frame > mixed + (Uint64)AUDIO_SCHEDULE_MAX_LEAD * bufferFrames)
+    {
+        anchored = true;
+        anchorTick = tick;
+        anchorFrame = mixed + bufferFrames;
+        frame = anchorFrame;
+    }
+    if (!queue.push({chunk, frame, SDL_GetPerformanceCounter(), priority}))
+    {
+        dropped++;
+        return false;
+    }
+    return true;
+}
+
+void AudioMixer::report()
+{
+    cout << "[audio] buffer " << bufferFrames << " frames (" << bufferMs << " ms), ";
+    if (latencyCount > 0)
+    {
+        cout << "trigger to output avg " << latencySum / latencyCount << " ms, max " << latencyMax << " ms over "
+             << latencyCount << " sounds (" << late << " late, " << merged << " merged, " << stolen << " stolen, "
+             << voicesFull + dropped << " dropped), ";
+    }
+    cout << totalUnderruns << " underruns" << endl;
+}
+
+void AudioMixer::postMix(void *data, Uint8 *stream, int len)
+{
+    AudioMixer *mixer = static_cast<AudioMixer *>(data);
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (mixer->lastCallback != 0)
+    {
+        double gapMs = (double)(now - mixer->lastCallback) * 1000 / SDL_GetPerformanceFrequency();
+        if (gapMs > AUDIO_LATE_FACTOR * mixer->bufferMs)
+        {
+            SDL_AtomicAdd(&mixer->underruns, 1);
+            mixer->totalUnderruns++;
+        }
+    }
+    mixer->lastCallback = now;
+
+    SfxCommand command;
+    while (mixer->queue.pop(command))
+    {
+        mixer->startVoice(command);
+    }
+
+    int frames = len / (int)(sizeof(Sint16) * mixer->channels);
+    if (mixer->mixable)
+    {
+        for (SfxVoice &voice : mixer->voices)
+        {
+            if (voice.chunk)
+                mixer->mixVoice(voice, (Sint16 *)stream, frames, now);
+        }
+    }
+    mixer->frameClock += frames;
+    SDL_AtomicSet(&mixer->clock, (int)(Uint32)(mixer->frameClock / AUDIO_CLOCK_GRANULE));
+}
+
+void AudioMixer::startVoice(const SfxCommand &command)
+{
+    Uint64 mergeFrames = (Uint64)frequency * SFX_MERGE_MS / 1000;
+    SfxVoice *slot = nullptr;
+    for (SfxVoice &voice : voices)
+    {
+        if (voice.chunk == command.chunk && voice.startFrame + mergeFrames >= command.frame &&
+            command.frame + mergeFrames >= voice.startFrame)
+        {
+            voice.priority = max(voice.priority, command.priority);
+            merged++;
+            return;
+        }
+        if (!voice.chunk)
+        {
+            slot = &voice;
+        }
+    }
+    if (!slot)
+    {
+        for (SfxVoice &voice : voices)
+        {
+            if (voice.priority <= command.priority &&
+                (!slot || voice.priority < slot->priority || (voice.priority == slot->priority && voice.position > slot->position)))
+            {
+                slot = &voice;
+            }
+        }
+        if (!slot)
+        {
+            voicesFull++;
+            return;
+        }
+        stolen++;
+    }
+    slot->chunk = command.chunk;
+    slot->startFrame = command.frame;
+    slot->position = 0;
+    slot->issued = command.issued;
+    slot->priority = command.priority;
+}
+
+// Adds the part of the voice that falls into this buffer, starting at its scheduled frame, with
+// the chunk's volume and clipping at the 16-bit limits. Full-volume sounds, the usual case, are
+// added eight samples at a time with SSE2's saturating add.
+void AudioMixer::mixVoice(SfxVoice &voice, Sint16 *out, int frames, Uint64 now)
+{
+    int offset = 0;
+    if (voice.startFrame > frameClock)
+    {
+        if (voice.startFrame - frameClock >= (Uint64)frames)
+            return;
+        offset = (int)(voice.startFrame - frameClock);
+    }
+    if (voice.position == 0)
+    {
+        if (voice.startFrame < frameClock)
+            late++;
+        double ms = (double)(now - voice.issued) * 1000 / SDL_GetPerformanceFrequency() + 1000.0 * offset / frequency + bufferMs;
+        latencySum += ms;
+        latencyMax = max(latencyMax, ms);
+        latencyCount++;
+    }
+
+    const Sint16 *src = (const Sint16 *)voice.chunk->abuf + voice.position;
+    Sint16 *dst = out + offset * channels;
+    int count = (int)min<Uint32>((Uint32)(frames - offset) * channels, voice.chunk->alen / sizeof(Sint16) - voice.position);
+    int volume = voice.chunk->volume;
+    int i = 0;
+#ifdef __SSE2__
+    if (volume == MIX_MAX_VOLUME)
+    {
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i sum = _mm_adds_epi16(_mm_loadu_si128((const __m128i *)(dst + i)), _mm_loadu_si128((const __m128i *)(src + i)));
+            _mm_storeu_si128((__m128i *)(dst + i), sum);
+        }
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        int sample = dst[i] + src[i] * volume / MIX_MAX_VOLUME;
+        dst[i] = (Sint16)min(32767, max(-32768, sample));
+    }
+
+    voice.position += count;
+    if (voice.position >= voice.chunk->alen / sizeof(Sint16))
+        voice = SfxVoice();
+}
+
+// ============================= MUSIC STREAM ============================= //
+// The music is decoded once into a memory-mapped PCM cache in the device format, rebuilt when the
+// source or device format changes, and streamed from it by a callback that only copies samples.
+#define MUSIC_CACHE_ENTRY "music"
+#define MUSIC_PREFETCH_MS 2000
+#define MUSIC_PREFETCH_INTERVAL 100
+#define MUSIC_PAGE_SIZE 4096
+#define MUSIC_TEMP_MAX_AGE 10 // minutes; an older temporary belongs to no running writer
+
+class MusicStream
+{
+public:
+    static Uint32 hash(SDL_RWops *source);
+    bool open(ResourceRegistry &resources, const string &path, Uint32 sourceHash);
+    static bool write(const string &path, const Mix_Chunk *decoded, Uint32 sourceHash);
+    bool isOpen() const { return frameCount > 0; }
+    bool isPlaying() const { return playing; }
+    bool play();
+    void stop();
+    void close();
+    void report();
+
+private:
+    AssetPack cache;
+    MappingHandle mapping;
+    const Sint16 *samples = nullptr;
+    Uint32 frameCount = 0;
+    int frequency = 0, channels = 0;
+    bool playing = false;
+    Uint32 frame = 0;
+    SDL_atomic_t position;
+    SDL_atomic_t stopping;
+    SDL_Thread *prefetcher = nullptr;
+    Uint64 started = 0, elapsed = 0;
+    Uint64 feedTime = 0, prefetchTime = 0;
+    int feeds = 0;
+    volatile Uint8 sink = 0;
+
+    static void feed(void *data, Uint8 *stream, int len);
+    static int prefetch(void *data);
+};
+
+// FNV-1a over the whole source, read in blocks; the stream is left back at its start.
+Uint32 MusicStream::hash(SDL_RWops *source)
+{
+    Uint32 value = 2166136261u;
+    Uint8 block[16384];
+    size_t count;
+    while ((count = SDL_RWread(source, block, 1, sizeof(block))) > 0)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            value = (value ^ block[i]) * 16777619u;
+        }
+    }
+    SDL_RWseek(source, 0, RW_SEEK_SET);
+    return value;
+}
+
+// Maps the cache if it was decoded from a source with this hash for the current device.
+bool MusicStream::open(ResourceRegistry &resources, const string &path, Uint32 sourceHash)
+{
+    close();
+    int deviceFrequency = 0, deviceChannels = 0;
+    Uint16 format = 0;
+    if (!Mix_QuerySpec(&deviceFrequency, &format, &deviceChannels) || !cache.open(path))
+        return false;
+    const PackEntry *entry = cache.find(MUSIC_CACHE_ENTRY);
+    if (!entry || entry->type != PACK_SOUND || entry->info[0] != (Uint32)deviceFrequency || entry->info[1] != format ||
+        format != AUDIO_S16SYS || entry->info[2] != (Uint32)deviceChannels || entry->info[3] != sourceHash ||
+        entry->size < sizeof(Sint16) * deviceChannels)
+    {
+        cache.close();
+        return false;
+    }
+    mapping = resources.mapping("music.pcm", &cache, entry->size);
+    samples = (const Sint16 *)cache.data(entry);
+    frameCount = (Uint32)(entry->size / (sizeof(Sint16) * deviceChannels));
+    frequency = deviceFrequency;
+    channels = deviceChannels;
+    frame = 0;
+    return true;
+}
+
+bool MusicStream::write(const string &path, const Mix_Chunk *decoded, Uint32 sourceHash)
+{
+    int deviceFrequency = 0, deviceChannels = 0;
+    Uint16 format = 0;
+    if (!decoded || !Mix_QuerySpec(&deviceFrequency, &format, &deviceChannels))
+        return false;
+    filesystem::path cachePath(path);
+    string prefix = cachePath.filename().string() + ".tmp";
+    error_code error;
+    auto cutoff = filesystem::file_time_type::clock::now() - chrono::minutes(MUSIC_TEMP_MAX_AGE);
+    for (const auto &file : filesystem::directory_iterator(cachePath.parent_path(), error))
+    {
+        error_code ignored;
+        if (file.path().filename().string().compare(0, prefix.size(), prefix) == 0 &&
+            filesystem::last_write_time(file.path(), ignored) < cutoff)
+            filesystem::remove(file.path(), ignored);
+    }
+    // Unique per writer, so two instances building the cache at once do not share a temporary.
+    string temporary = path + ".tmp" + to_string(random_device()());
+    ofstream out(temporary, ios::binary);
+    if (!out.is_open())
+        return false;
+    PackHeader header = {PACK_MAGIC, PACK_VERSION, 1, 0};
+    PackEntry entry = {};
+    strcpy(entry.name, MUSIC_CACHE_ENTRY);
+    entry.type = PACK_SOUND;
+    entry.offset = (sizeof(PackHeader) + sizeof(PackEntry) + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+    entry.size = decoded->alen;
+    entry.info[0] = deviceFrequency;
+    entry.info[1] = format;
+    entry.info[2] = deviceChannels;
+    entry.info[3] = sourceHash;
+    const char padding[PACK_ALIGNMENT] = {};
+    out.write((const char *)&header, sizeof(header));
+    out.write((const char *)&entry, sizeof(entry));
+    out.write(padding, entry.offset - sizeof(header) - sizeof(entry));
+    out.write((const char *)decoded->abuf, decoded->alen);
+    out.close();
+    if (out.fail() || (filesystem::rename(temporary, path, error), error))
+    {
+        filesystem::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+// Starts (or resumes) from the current position. The device must still have the format the
+// cache was opened for, which holds across a reopen with a different buffer size.
+bool MusicStream::play()
+{
+    int deviceFrequency = 0, deviceChannels = 0;
+    Uint16 format = 0;
+    if (!isOpen() || playing || !Mix_QuerySpec(&deviceFrequency, &format, &deviceChannels) ||
+        deviceFrequency != frequency || deviceChannels != channels || format != AUDIO_S16SYS)
+        return false;
+    SDL_AtomicSet(&position, (int)frame);
+    SDL_AtomicSet(&stopping, 0);
+    prefetcher = SDL_CreateThread(prefetch, "music prefetch", this);
+    started = SDL_GetPerformanceCounter();
+    playing = true;
+    Mix_HookMusic(feed, this);
+    return true;
+}
+
+void MusicStream::stop()
+{
+    if (!playing)
+        return;
+    Mix_HookMusic(NULL, NULL);
+    SDL_AtomicSet(&stopping, 1);
+    SDL_WaitThread(prefetcher, NULL);
+    prefetcher = nullptr;
+    elapsed += SDL_GetPerformanceCounter() - started;
+    playing = false;
+}
+
+void MusicStream::close()
+{
+    stop();
+    mapping.reset();
+    cache.close();
+    samples = nullptr;
+    frameCount = 0;
+}
+
+void MusicStream::report()
+{
+    if (elapsed == 0)
+        return;
+    double seconds = (double)elapsed / SDL_GetPerformanceFrequency();
+    double feedMs = (double)feedTime * 1000 / SDL_GetPerformanceFrequency();
+    double prefetchMs = (double)prefetchTime * 1000 / SDL_GetPerformanceFrequency();
+    cout << "[music] streamed " << seconds << " s from a " << (double)frameCount * channels * sizeof(Sint16) / (1024 * 1024)
+         << " MB PCM cache: callback " << (feeds > 0 ? feedMs * 1000 / feeds : 0) << " us per buffer, "
+         << feedMs / 10 / seconds << "% of a core; prefetch " << prefetchMs / 10 / seconds << "% of a core" << endl;
+}
+
+// The stream arrives filled with silence; the music loops by wrapping back to the first frame.
+void MusicStream::feed(void *data, Uint8 *stream, int len)
+{
+    MusicStream *music = static_cast<MusicStream *>(data);
+    Uint64 start = SDL_GetPerformanceCounter();
+    size_t frameBytes = sizeof(Sint16) * music->channels;
+    Uint32 frames = (Uint32)(len / frameBytes);
+    while (frames > 0)
+    {
+        Uint32 count = min(frames, music->frameCount - music->frame);
+        memcpy(stream, music->samples + (size_t)music->frame * music->channels, count * frameBytes);
+        stream += count * frameBytes;
+        frames -= count;
+        music->frame = (music->frame + count) % music->frameCount;
+    }
+    SDL_AtomicSet(&music->position, (int)music->frame);
+    music->feedTime += SDL_GetPerformanceCounter() - start;
+    music->feeds++;
+}
+
+int MusicStream::prefetch(void *data)
+{
+    MusicStream *music = static_cast<MusicStream *>(data);
+    const Uint8 *bytes = (const Uint8 *)music->samples;
+    size_t length = (size_t)music->frameCount * music->channels * sizeof(Sint16);
+    size_t ahead = min(length, (size_t)music->frequency * MUSIC_PREFETCH_MS / 1000 * music->channels * sizeof(Sint16));
+    while (!SDL_AtomicGet(&music->stopping))
+    {
+        Uint64 start = SDL_GetPerformanceCounter();
+        size_t from = (size_t)(Uint32)SDL_AtomicGet(&music->position) * music->channels * sizeof(Sint16);
+        Uint8 touched = 0;
+        for (size_t offset = 0; offset < ahead; offset += MUSIC_PAGE_SIZE)
+        {
+            touched ^= bytes[(from + offset) % length];
+        }
+        music->sink = touched;
+        music->prefetchTime += SDL_GetPerformanceCounter() - start;
+        SDL_Delay(MUSIC_PREFETCH_INTERVAL);
+    }
+    return 0;
+}
+
+// ============================= ASSET LOADER ============================= //
+// Decodes assets on a small pool of worker threads while the main thread keeps presenting frames.
+// Jobs start in the order they were added, so whatever the first frame needs goes first. Jobs only
+// decode into memory; the main thread checks done() and creates textures itself, since the
+// renderer belongs to it. Each finished job pushes wakeEvent so an idle game loop notices.
+#define ASSET_LOADER_MAX_THREADS 4
+
+class AssetLoader
+{
+public:
+    int add(function<void()> job)
+    {
+        jobs.push_back(job);
+        return (int)jobs.size() - 1;
+    }
+
+    // Starts the workers; no more jobs can be added after this. Without threads the jobs run here.
+    void start(int threadCount, Uint32 event)
+    {
+        wakeEvent = event;
+        finished = vector<SDL_atomic_t>(jobs.size());
+        SDL_AtomicSet(&nextJob, 0);
+        for (int i = 0; i < threadCount; ++i)
+        {
+            SDL_Thread *thread = SDL_CreateThread(worker, "asset loader", this);
+            if (thread)
+                threads.push_back(thread);
+        }
+        if (threads.empty())
+        {
+            wait();
+        }
+    }
+
+    bool done(int job) { return job < 0 || SDL_AtomicGet(&finished[job]) != 0; }
+
+    bool allDone()
+    {
+        for (int i = 0; i < (int)jobs.size(); ++i)
+        {
+            if (!done(i))
+                return false;
+        }
+        return true;
+    }
+
+    // Blocks until every job has run, helping with the remaining ones on this thread.
+    void wait()
+    {
+        while (runNext())
+        {
+        }
+        for (SDL_Thread *thread : threads)
+        {
+            SDL_WaitThread(thread, NULL);
+        }
+        threads.clear();
+    }
+
+private:
+    vector<function<void()>> jobs;
+    vector<SDL_atomic_t> finished;
+    vector<SDL_Thread *> threads;
+    SDL_atomic_t nextJob = {};
+    Uint32 wakeEvent = (Uint32)-1;
+
+    bool runNext()
+    {
+        int job = SDL_AtomicAdd(&nextJob, 1);
+        if (job >= (int)jobs.size())
+            return false;
+        jobs[job]();
+        SDL_AtomicSet(&finished[job], 1);
+        if (wakeEvent != (Uint32)-1)
+        {
+            SDL_Event event = {};
+            event.type = wakeEvent;
+            SDL_PushEvent(&event);
+        }
+        return true;
+    }
+
+    static int worker(void *data)
+    {
+        AssetLoader *loader = static_cast<AssetLoader *>(data);
+        while (loader->runNext())
+        {
+        }
+        return 0;
+    }
+};
+
+// ============================= OPTIONS ============================= //
+// Settings taken from the command line.
+struct GameOptions
+{
+    int menuFps = 20;
+    bool cpuReport = false;
+    bool headless = false;
+    bool softwareRenderer = false;
+    int benchFrames = 0;
+    const char *screenshotDir = nullptr;
+    const char *recordPath = nullptr;
+    const char *sessionDir = nullptr;
+    const char *replayPath = nullptr;
+    const char *replayOut = nullptr;
+    const char *farmSessions = nullptr;
+    const char *farmOut = nullptr;
+    int farmJobs = 0;
+    int particleStress = 0;
+    int particleBudget = 0;
+    bool simThread = false;
+    bool startupReport = false;
+    int memoryBudget = 0;
+    int audioBuffer = 0;
+};
+
+// ============================= PROFILER ============================= //
+// Tracks wall time, process CPU time and presented frames for each game state, so the
+// cost of the menu, gameplay and death screen can be compared. Reports are printed every
+// few seconds and once more on exit when enabled.
+#define PROFILER_REPORT_INTERVAL 5000
+
+// Timed pieces of work that are reported next to the per-state numbers.
+enum ProfileSection
+{
+    PROFILE_READBACK,
+    PROFILE_PARTICLE_UPDATE,
+    PROFILE_PARTICLE_DRAW,
+    PROFILE_SECTION_COUNT
+};
+
+const char *profileSectionNames[PROFILE_SECTION_COUNT] = {"frame readback", "particle update", "particle draw"};
+
+// CPU time used by the whole process (all threads, including audio), in seconds.
+double processCpuSeconds()
+{
+#ifdef _WIN32
+    FILETIME creation, exitTime, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exitTime, &kernel, &user))
+        return 0;
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return (k.QuadPart + u.QuadPart) * 1e-7;
+#else
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+class Profiler
+{
+public:
+    bool enabled = false;
+
+    void sample(GameState state);
+    void countPresent() { interval[currentState].presents++; }
+    void addSection(ProfileSection section, double ms);
+    void report(bool final);
+
+private:
+    struct StateTimes
+    {
+        double wall = 0, cpu = 0;
+        int presents = 0;
+    };
+    struct SectionTimes
+    {
+        double ms = 0, maxMs = 0;
+        int count = 0;
+    };
+    StateTimes interval[3], total[3];
+    SectionTimes sectionInterval[PROFILE_SECTION_COUNT], sectionTotal[PROFILE_SECTION_COUNT];
+    GameState currentState = MAIN_MENU;
+    Uint64 lastCounter = 0;
+    double lastCpu = 0;
+    Uint32 lastReport = 0;
+
+    void print(const char *title, StateTimes times[3], SectionTimes sections[PROFILE_SECTION_COUNT]);
+};
+
+void Profiler::addSection(ProfileSection section, double ms)
+{
+    SectionTimes &times = sectionInterval[section];
+    times.ms += ms;
+    times.maxMs = max(times.maxMs, ms);
+    times.count++;
+}
+
+// Charges the time since the previous sample to the state the game was in, then switches.
+void Profiler::sample(GameState state)
+{
+    if (!enabled)
+        return;
+    Uint64 counter = SDL_GetPerformanceCounter();
+    double cpu = processCpuSeconds();
+    if (lastCounter != 0)
+    {
+        double wall = (double)(counter - lastCounter) / SDL_GetPerformanceFrequency();
+        interval[currentState].wall += wall;
+        interval[currentState].cpu += cpu - lastCpu;
+    }
+    lastCounter = counter;
+    lastCpu = cpu;
+    currentState = state;
+
+    if (SDL_GetTicks() - lastReport >= PROFILER_REPORT_INTERVAL)
+    {
+        report(false);
+    }
+}
+
+void Profiler::report(bool final)
+{
+    if (!enabled)
+        return;
+    for (int i = 0; i < 3; ++i)
+    {
+        total[i].wall += interval[i].wall;
+        total[i].cpu += interval[i].cpu;
+        total[i].presents += interval[i].presents;
+    }
+    for (int i = 0; i < PROFILE_SECTION_COUNT; ++i)
+    {
+        sectionTotal[i].ms += sectionInterval[i].ms;
+        sectionTotal[i].maxMs = max(sectionTotal[i].maxMs, sectionInterval[i].maxMs);
+        sectionTotal[i].count += sectionInterval[i].count;
+    }
+    if (final)
+    {
+        print("total", total, sectionTotal);
+    }
+    else
+    {
+        print("last interval", interval, sectionInterval);
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        interval[i] = StateTimes();
+    }
+    for (int i = 0; i < PROFILE_SECTION_COUNT; ++i)
+    {
+        sectionInterval[i] = SectionTimes();
+    }
+    lastReport = SDL_GetTicks();
+}
+
+void Profiler::print(const char *title, StateTimes times[3], SectionTimes sections[PROFILE_SECTION_COUNT])
+{
+    const char *names[3] = {"menu", "play", "death"};
+    cout << "[profile] " << title << ":";
+    for (int i = 0; i < 3; ++i)
+    {
+        if (times[i].wall <= 0)
+            continue;
+        cout << "  " << names[i] << " " << (int)(100 * times[i].cpu / times[i].wall + 0.5) << "% CPU, "
+             << (int)(times[i].presents / times[i].wall + 0.5) << " fps";
+    }
+    for (int i = 0; i < PROFILE_SECTION_COUNT; ++i)
+    {
+        if (sections[i].count == 0)
+            continue;
+        cout << "  " << profileSectionNames[i] << " avg " << sections[i].ms / sections[i].count
+             << " ms, max " << sections[i].maxMs << " ms";
+    }
+    cout << endl;
+}
+
+// ============================= STARTUP TIMER ============================= //
+// Splits startup into phases, each timed from the end of the one before, and prints them on one
+// line once the game is playable, so a slow window, renderer or audio device shows up by name.
+#define STARTUP_MAX_PHASES 16
+
+class StartupTimer
+{
+public:
+    bool enabled = false;
+
+    void begin() { start = last = SDL_GetPerformanceCounter(); }
+
+    void mark(const char *name)
+    {
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (count < STARTUP_MAX_PHASES)
+        {
+            names[count] = name;
+            ms[count++] = (double)(now - last) * 1000 / SDL_GetPerformanceFrequency();
+        }
+        last = now;
+    }
+
+    double elapsed() { return (double)(SDL_GetPerformanceCounter() - start) * 1000 / SDL_GetPerformanceFrequency(); }
+
+    void report(double firstFrameMs)
+    {
+        if (!enabled)
+            return;
+        cout << "[startup]";
+        for (int i = 0; i < count; ++i)
+        {
+            cout << (i ? ", " : " ") << names[i] << " " << ms[i] << " ms";
+        }
+        if (firstFrameMs > 0)
+        {
+            cout << "; first frame at " << firstFrameMs << " ms";
+        }
+        cout << "; interactive at " << elapsed() << " ms" << endl;
+    }
+
+private:
+    Uint64 start = 0, last = 0;
+    const char *names[STARTUP_MAX_PHASES];
+    double ms[STARTUP_MAX_PHASES];
+    int count = 0;
+};
+
+// ============================= FRAME RECORDER ============================= //
+// Records gameplay to a Y4M video, which any player or encoder can read without a codec.
+// Each presented frame is read back into one slot of a preallocated ring; a writer thread
+// converts the slots to YUV and writes them, so the game thread never waits on the disk.
+// When the writer falls behind and the ring is full, new frames are dropped and counted,
+// and the writer repeats the previous frame to keep the video's timeline at 60 fps; captures
+// landing in a slot that was already written are skipped for the same reason.
+// Offline renders pass their own frame numbers and wait for a free slot instead of dropping.
+#define RECORDER_SLOTS 8
+#define RECORDER_FPS 60
+
+class FrameRecorder
+{
+public:
+    bool start(const char *path, int frameWidth, int frameHeight);
+    bool active() { return thread != nullptr; }
+    double capture(RenderBackend *backend, int frame = -1, bool wait = false);
+    bool stop();
+
+private:
+    struct Slot
+    {
+        vector<Uint8> pixels;
+        int frame;
+    };
+    Slot slots[RECORDER_SLOTS];
+    vector<Uint8> yuv;
+    int width = 0, height = 0;
+    string path;
+    ofstream file;
+    SDL_Thread *thread = nullptr;
+    SDL_sem *framesReady = nullptr;
+    SDL_sem *slotsFree = nullptr;
+    SDL_atomic_t writeIndex, readIndex, stopping, writeFailed;
+    Uint32 startTime = 0;
+    int framesCaptured = 0, framesDropped = 0, framesWritten = 0, framesSkipped = 0;
+    double readbackMs = 0;
+
+    static int writerThread(void *data);
+    void writeFrames();
+    void writeFrame();
+};
+
+// The header is only written once the writer thread is running, so a failed start leaves no
+// file behind and nothing allocated.
+bool FrameRecorder::start(const char *outputPath, int frameWidth, int frameHeight)
+{
+    width = frameWidth;
+    height = frameHeight;
+    path = outputPath;
+    file.open(path, ios::binary);
+    if (!file.is_open())
+    {
+        cerr << "Could not open " << path << " for recording" << endl;
+        return false;
+    }
+
+    // All memory is allocated up front; recording never allocates per frame.
+    for (auto &slot : slots)
+    {
+        slot.pixels.resize(width * height * 4);
+    }
+    yuv.resize(width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2));
+    SDL_AtomicSet(&writeIndex, 0);
+    SDL_AtomicSet(&readIndex, 0);
+    SDL_AtomicSet(&stopping, 0);
+    SDL_AtomicSet(&writeFailed, 0);
+    framesReady = SDL_CreateSemaphore(0);
+    slotsFree = SDL_CreateSemaphore(RECORDER_SLOTS);
+    startTime = SDL_GetTicks();
+    thread = framesReady && slotsFree ? SDL_CreateThread(writerThread, "FrameWriter", this) : nullptr;
+    if (!thread)
+    {
+        cerr << "Could not start the recording thread! SDL Error: " << SDL_GetError() << endl;
+        SDL_DestroySemaphore(framesReady);
+        SDL_DestroySemaphore(slotsFree);
+        framesReady = slotsFree = nullptr;
+        file.close();
+        error_code error;
+        filesystem::remove(path, error);
+        return false;
+    }
+    // The writer only touches the file after the first capture, which comes after this.
+    file << "YUV4MPEG2 W" << width << " H" << height << " F" << RECORDER_FPS << ":1 Ip A1:1 C420jpeg\n";
+    return true;
+}
+
+// Copies the frame that was just drawn into the next free slot. Live recording stamps it with
+// the wall clock; offline renders pass the frame number. Returns the readback time in
+// milliseconds, or 0 when the frame was dropped.
+double FrameRecorder::capture(RenderBackend *backend, int frame, bool wait)
+{
+    if (wait ? SDL_SemWait(slotsFree) != 0 : SDL_SemTryWait(slotsFree) != 0)
+    {
+        framesDropped++;
+        return 0;
+    }
+    int write = SDL_AtomicGet(&writeIndex);
+
+    Slot &slot = slots[write % RECORDER_SLOTS];
+    Uint64 start = SDL_GetPerformanceCounter();
+    if (!backend->readPixels(slot.pixels.data(), width * 4))
+    {
+        SDL_SemPost(slotsFree);
+        framesDropped++;
+        return 0;
+    }
+    double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    readbackMs += ms;
+    slot.frame = frame >= 0 ? frame : (int)((Uint64)(SDL_GetTicks() - startTime) * RECORDER_FPS / 1000);
+    framesCaptured++;
+
+    SDL_AtomicSet(&writeIndex, write + 1);
+    SDL_SemPost(framesReady);
+    return ms;
+}
+
+int FrameRecorder::writerThread(void *data)
+{
+    static_cast<FrameRecorder *>(data)->writeFrames();
+    return 0;
+}
+
+// Writes the frame currently in yuv once, unless an earlier write has already failed.
+void FrameRecorder::writeFrame()
+{
+    if (SDL_AtomicGet(&writeFailed))
+        return;
+    file << "FRAME\n";
+    file.write((const char *)yuv.data(), yuv.size());
+    if (!file.good())
+        SDL_AtomicSet(&writeFailed, 1);
+    else
+        framesWritten++;
+}
+
+void FrameRecorder::writeFrames()
+{
+    while (true)
+    {
+        SDL_SemWait(framesReady);
+        int read = SDL_AtomicGet(&readIndex);
+        if (read == SDL_AtomicGet(&writeIndex))
+        {
+            if (SDL_AtomicGet(&stopping))
+                break;
+            continue;
+        }
+
+        // A capture whose 1/60 s slot is already written is skipped, so a game loop running a
+        // little faster than 60 fps does not stretch the video. For any slots missed while the
+        // game was idle or frames were dropped, the previous frame (still in yuv) is repeated
+        // before the new one goes out. After a write error (a full disk) slots are still
+        // drained so capture() keeps going, but nothing more is written; stop() reports it.
+        Slot &slot = slots[read % RECORDER_SLOTS];
+        if (SDL_AtomicGet(&writeFailed))
+        {
+            // Drained without converting or writing.
+        }
+        else if (slot.frame < framesWritten)
+        {
+            framesSkipped++;
+        }
+        else
+        {
+            int repeats = framesWritten > 0 ? slot.frame - framesWritten : 0;
+            for (int i = 0; i < repeats && !SDL_AtomicGet(&writeFailed); ++i)
+                writeFrame();
+            if (!SDL_AtomicGet(&writeFailed))
+            {
+                SDL_ConvertPixels(width, height, SDL_PIXELFORMAT_ARGB8888, slot.pixels.data(), width * 4,
+                                  SDL_PIXELFORMAT_IYUV, yuv.data(), width);
+                // The first capture may land after slot 0; fill the lead-in with it.
+                int copies = framesWritten > 0 ? 1 : slot.frame + 1;
+                for (int i = 0; i < copies && !SDL_AtomicGet(&writeFailed); ++i)
+                    writeFrame();
+            }
+        }
+        SDL_AtomicSet(&readIndex, read + 1);
+        SDL_SemPost(slotsFree);
+    }
+}
+
+// Returns false if any part of the video failed to reach the disk.
+bool FrameRecorder::stop()
+{
+    if (!thread)
+        return true;
+    SDL_AtomicSet(&stopping, 1);
+    SDL_SemPost(framesReady);
+    SDL_WaitThread(thread, NULL);
+    thread = nullptr;
+    SDL_DestroySemaphore(framesReady);
+    SDL_DestroySemaphore(slotsFree);
+    framesReady = slotsFree = nullptr;
+    file.close();
+    bool written = !SDL_AtomicGet(&writeFailed) && !file.fail();
+    cout << "[record] " << framesCaptured << " frames captured, " << framesDropped << " dropped, "
+         << framesWritten << " written, " << framesSkipped << " skipped, readback avg "
+         << (framesCaptured > 0 ? readbackMs / framesCaptured : 0) << " ms" << endl;
+    if (!written)
+    {
+        cerr << "[record] writing " << path << " failed (disk full?); the video is truncated after "
+             << framesWritten << " frames" << endl;
+    }
+    return written;
+}
+
+// ============================= SIMULATION THREAD ============================= //
+// With --sim-thread the simulation runs on its own thread at a fixed 60 ticks per second, and
+// the main thread only handles input and draws. Each tick the simulation thread publishes an
+// immutable snapshot of everything the renderer needs into a lock-free triple buffer, and the
+// main thread draws the newest one. A slow present or a vsync wait then delays the next frame
+// but never the next tick. Steering reaches the simulation through a single-producer,
+// single-consumer queue. The simulation and session belong to the thread while it runs.
+#define SNAPSHOT_MAX_OBSTACLES 64
+#define SNAPSHOT_HIT_LOG 16
+#define STEER_QUEUE_SIZE 64
+
+// What one tick looks like to the renderer. Hits are kept in a running log rather than per
+// tick, so the renderer still sees every pickup and crash when it skips a snapshot.
+struct GameSnapshot
+{
+    int tick = 0;
+    int score = 0;
+    int obstacleSpeed = 0;
+    bool dead = false;
+    SimCar blueCar, redCar;
+    int obstacleCount = 0;
+    Obstacle obstacles[SNAPSHOT_MAX_OBSTACLES];
+    int hitTotal = 0;
+    Obstacle hitLog[SNAPSHOT_HIT_LOG];
+
+    void capture(const Simulation &sim)
+    {
+        tick = sim.tick;
+        score = sim.score;
+        obstacleSpeed = sim.obstacleSpeed;
+        dead = sim.dead;
+        blueCar = sim.blueCar;
+        redCar = sim.redCar;
+        obstacleCount = min((int)sim.obstacles.size(), SNAPSHOT_MAX_OBSTACLES);
+        copy(sim.obstacles.begin(), sim.obstacles.begin() + obstacleCount, obstacles);
+        for (int i = 0; i < sim.events.hitCount; ++i)
+        {
+            hitLog[hitTotal++ % SNAPSHOT_HIT_LOG] = sim.events.hits[i];
+        }
+    }
+};
+
+// Three snapshots: the writer fills the back one, then swaps it with the middle one in a single
+// atomic exchange that also marks it fresh. The reader swaps a fresh middle with its front one.
+// Neither side ever waits, and the reader always gets the newest complete snapshot.
+#define SNAPSHOT_FRESH 4
+
+class SnapshotBuffer
+{
+public:
+    SnapshotBuffer() { reset(); }
+    // Only while no writer is running.
+    void reset()
+    {
+        backIndex = 0;
+        frontIndex = 2;
+        SDL_AtomicSet(&middle, 1);
+    }
+    GameSnapshot &back() { return slots[backIndex]; }
+    void publish() { backIndex = SDL_AtomicSet(&middle, backIndex | SNAPSHOT_FRESH) & 3; }
+    // The newest snapshot, or null when nothing was published since the last call.
+    const GameSnapshot *acquire()
+    {
+        if (!(SDL_AtomicGet(&middle) & SNAPSHOT_FRESH))
+            return nullptr;
+        frontIndex = SDL_AtomicSet(&middle, frontIndex) & 3;
+        return &slots[frontIndex];
+    }
+
+private:
+    GameSnapshot slots[3];
+    int backIndex, frontIndex;
+    SDL_atomic_t middle;
+};
+
+// Steering presses from the main thread to the simulation thread. A full queue drops the press.
+class SteerQueue
+{
+public:
+    SteerQueue()
+    {
+        SDL_AtomicSet(&head, 0);
+        SDL_AtomicSet(&tail, 0);
+    }
+    bool push(bool red)
+    {
+        int write = SDL_AtomicGet(&tail);
+        if (write - SDL_AtomicGet(&head) == STEER_QUEUE_SIZE)
+            return false;
+        entries[write % STEER_QUEUE_SIZE] = red;
+        SDL_AtomicSet(&tail, write + 1);
+        return true;
+    }
+    bool pop(bool &red)
+    {
+        int read = SDL_AtomicGet(&head);
+        if (read == SDL_AtomicGet(&tail))
+            return false;
+        red = entries[read % STEER_QUEUE_SIZE];
+        SDL_AtomicSet(&head, read + 1);
+        return true;
+    }
+
+private:
+    bool entries[STEER_QUEUE_SIZE];
+    SDL_atomic_t head, tail;
+};
+
+// Death-screen buttons, for hover highlighting and clicks.
+enum DeathScreenButton
+{
+    BUTTON_NONE,
+    BUTTON_RESTART,
+    BUTTON_HOME
+};
+
+// Lane marking dashes on the road background.
+#define ROAD_DASH_LENGTH 30
+#define ROAD_DASH_PERIOD 60
+
+// ============================= GAME CLASS ============================= //
+// Manages the game loop, event handling, rendering, and state transitions.
+class Game
+{
+public:
+    Game(const GameOptions &gameOptions);
+    ~Game();
+
+    void init(const char *title, int xpos, int ypos, int width, int height, bool fullscreen);
+    void handleEvents(int timeout);
+    void update();
+    void render();
+    void clean();
+    bool running() { return isRunning; };
+    bool idle() { return currentState != NORMAL_MODE; };
+    int idleTimeout();
+    void runBenchmark();
+    void saveScreenshots();
+    bool renderReplay();
+
+private:
+    GameOptions options;
+    Profiler profiler;
+    FrameRecorder recorder;
+    bool isRunning;
+    bool needsRedraw = true;
+    Uint32 lastMenuStep = 0;
+    GameState currentState;
+    SDL_Window *window;
+    RenderBackend *backend = nullptr;
+    string basePath;
+    AssetPack pack;
+    AssetLoader loader;
+    AssetLoader audioLoader;
+    bool audioOpen = false;
+    AudioMixer audio;
+    Uint32 lastAudioCheck = 0;
+    bool audioGrowPending = false;
+    bool audioUnderran = false;
+    int audioCleanSessions = 0;
+    Uint32 wakeEvent = (Uint32)-1;
+    SDL_Surface *spriteSurfaces[SPRITE_COUNT] = {};
+    int spriteJobs[SPRITE_COUNT];
+    int fontJob = -1, soundJob = -1, musicJob = -1;
+    bool menuReady = false;
+    bool atlasReady = false;
+    bool musicStarted = false;
+    bool assetsReady = false;
+    double firstFrameMs = 0;
+    StartupTimer startup;
+    Simulation sim;
+    Session session;
+    int sessionsSaved = 0;
+    GameSnapshot view;
+    int lastHitSeen = 0;
+    SnapshotBuffer snapshots;
+    SteerQueue steerQueue;
+    SDL_Thread *simThread = nullptr;
+    SDL_atomic_t simStopping;
+    SpriteAtlas atlas;
+    SpriteBatch batch;
+    ParticleSystem particles;
+    mt19937 stressRng;
+    ResourceRegistry resources;
+    TextureHandle background;
+    TextureHandle deathScreen;
+    bool deathScreenValid = false;
+    int hoveredButton = BUTTON_NONE;
+    int roadScroll = 0;
+    int playTextYPosition;
+    int playTextDirection;
+    const int textSpeed = 1;
+    const int animationRange = 10;
+    BakedFontAtlas fontAtlas;
+    BitmapFont text;
+    TextLabel titleLabel, playLabel1, playLabel2;
+    TextLabel restartLabel, homeLabel, scoreLabel, highscoreLabel;
+    SDL_Rect titleTextRect = {};
+    SDL_Rect playTextRect1 = {};
+    SDL_Rect playTextRect2 = {};
+    int initialPlayTextYPosition;
+    SoundHandle circlePickupSound;
+    SoundHandle deathSound;
+    SoundHandle circleMissSound;
+    SDL_Rect restartButtonRect, homeButtonRect;
+    MusicHandle backgroundMusic;
+    MusicStream music;
+    int highscore = 0;
+
+    void loadAssets();
+    void pollAssets();
+    void waitForAssets();
+    void buildMenuText();
+    void buildAtlas();
+    void openAudio();
+    bool openMixer(int bufferFrames);
+    void checkAudio();
+    void reopenAudio(int bufferFrames);
+    void saveAudioBuffer(int bufferFrames);
+    void playSound(const SoundHandle &sound, int tick, int priority);
+    string assetPath(const char *name);
+    SDL_Surface *loadImage(const char *name);
+    SoundHandle loadSound(const char *name);
+#ifndef BAKED_FONT
+    TTF_Font *loadFont(const char *name, int size);
+#endif
+    MusicHandle loadMusic(const char *name);
+    void prepareMusic(const char *name);
+    void handleEvent(const SDL_Event &event);
+    void updateGameplay();
+    void updateFromSimThread();
+    void startSimThread();
+    void stopSimThread();
+    static int simulationThread(void *data);
+    void runSimulation();
+    void steer(bool red);
+    void applySteer(bool red);
+    void playSounds(const SimEvents &events, int tick);
+    void enterDeathScreen();
+    void updateParticles(int ticks = 1);
+    void drawRoad(int top, int height);
+    void buildBackground();
+    void updateMenuAnimation();
+    void resetCars();
+    void endSession();
+    SpriteId obstacleSprite(ObstacleKind kind);
+    void draw();
+    SDL_Surface *readFrame();
+    void renderGameplay();
+    void captureDeathScreen();
+    void renderButtonHighlight();
+    int buttonAt(int x, int y);
+    void renderMenu();
+    void renderDeathScreen();
+    void renderScoreLine(const TextLabel &label, int value, int y);
+    string prefPath(const char *file);
+    void loadHighscore();
+    void saveHighscore();
+};
+
+Game::Game(const GameOptions &gameOptions) : options(gameOptions)
+{
+    profiler.enabled = options.cpuReport;
+    startup.enabled = options.startupReport;
+    if (options.menuFps < 1)
+        options.menuFps = 1;
+
+    // The stress test keeps the pool full and draws all of it.
+    particles.init(max(PARTICLE_CAPACITY, options.particleStress));
+    if (options.particleStress > 0)
+    {
+        particles.spawnBudget = options.particleStress;
+        particles.drawBudget = options.particleStress;
+    }
+    if (options.particleBudget > 0)
+    {
+        particles.drawBudget = options.particleBudget;
+    }
+}
+Game::~Game() {}
+
+// ============================= INIT METHOD ============================= //
+// Sets up SDL systems, creates the game window, loads assets, and initializes the game state.
+// Only video and events start here. Audio opens after the first frame is on screen, and the
+// joystick, haptic, controller and sensor subsystems are never started since the game only
+// reads the keyboard and mouse, which come with the events subsystem.
+void Game::init(const char *title, int xpos, int ypos, int width, int height, bool fullscreen)
+{
+    startup.begin();
+    int flags = 0;
+    if (fullscreen)
+    {
+        flags = SDL_WINDOW_FULLSCREEN;
+    }
+    // The SDL renderer draws at the display's real pixel density (see SdlBackend::init). The
+    // software blitter draws 1:1 into the window surface, so it keeps the scaled-up window.
+    if (!options.softwareRenderer)
+    {
+        flags |= SDL_WINDOW_ALLOW_HIGHDPI;
+        SDL_SetHint(SDL_HINT_WINDOWS_DPI_SCALING, "1");
+    }
+    if (options.headless)
+    {
+        // No display needed: the dummy drivers always exist, and frames go to a memory surface.
+        SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+        SDL_SetHint(SDL_HINT_AUDIODRIVER, "dummy");
+    }
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) == 0)
+    {
+        startup.mark("sdl init");
+        window = options.headless ? nullptr : SDL_CreateWindow(title, xpos, ypos, width, height, flags);
+        startup.mark("window");
+        if (options.softwareRenderer)
+        {
+            backend = new SoftwareBackend();
+        }
+        else
+        {
+            backend = new SdlBackend();
+        }
+        if ((!options.headless && !window) || !backend->init(window, width, height))
+        {
+            cerr << "Could not create a renderer! SDL Error: " << SDL_GetError() << endl;
+            isRunning = false;
+            return;
+        }
+        if (!resources.init(backend))
+        {
+            cerr << "Could not create the resource registry! SDL Error: " << SDL_GetError() << endl;
+            isRunning = false;
+            return;
+        }
+        resources.budget = (size_t)options.memoryBudget * 1024 * 1024;
+        startup.mark("renderer");
+
+#ifndef BAKED_FONT
+        if (TTF_Init() == -1)
+        {
+            cerr << "SDL_ttf could not initialize! SDL_ttf Error: " << TTF_GetError() << endl;
+            isRunning = false;
+            return;
+        }
+#endif
+        // SDL_image sets up its PNG loader here rather than lazily on whichever loader thread
+        // decodes first, since IMG_Init is not thread-safe.
+        if (!(IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG))
+        {
+            cerr << "SDL_image could not initialize! SDL_image Error: " << IMG_GetError() << endl;
+            isRunning = false;
+            return;
+        }
+
+        if (options.recordPath)
+        {
+            recorder.start(options.recordPath, width, height);
+        }
+
+        isRunning = true;
+        currentState = MAIN_MENU;
+        loadAssets();
+        resetCars();
+        loadHighscore();
+        startup.mark("asset queue");
+
+        // The one-shot tools render their first frame straight away, so they need everything.
+        if (options.headless || options.benchFrames > 0 || options.screenshotDir || options.replayPath)
+        {
+            waitForAssets();
+        }
+    }
+    else
+    {
+        isRunning = false;
+    }
+}
+
+// ============================= ASSET LOADING ============================= //
+// Loads textures, sounds, and fonts needed for the game.
+// Also sets default positions for the menu text and the death-screen buttons.
+// Assets come from assets.pack next to the executable when it exists (see packer.cpp),
+// otherwise from the asset files, found relative to the executable rather than the working directory.
+// The EMBED_ASSETS build has the pack compiled in and needs no files at all.
+// Decoding runs on the asset loader: the fonts first so the menu can show early, then the
+// sprites; sounds and music follow once audio is open. pollAssets() finishes each group on the
+// main thread as it arrives.
+void Game::loadAssets()
+{
+    char *exeDir = SDL_GetBasePath();
+    basePath = exeDir ? exeDir : "";
+    SDL_free(exeDir);
+#ifdef EMBED_ASSETS
+    pack.openMemory(embeddedAssetPack, embeddedAssetPack_SIZE);
+#else
+    pack.open(basePath + "assets.pack");
+#endif
+
+    restartButtonRect = {SCREEN_WIDTH / 2 - 50, SCREEN_HEIGHT / 2 - 20, 100, 40};
+    homeButtonRect = {SCREEN_WIDTH / 2 - 50, SCREEN_HEIGHT / 2 + 30, 100, 40};
+    buildBackground();
+    deathScreen = resources.texture("death screen", backend->createTarget(SCREEN_WIDTH, SCREEN_HEIGHT));
+
+#ifdef BAKED_FONT
+    fontAtlas.sizeCount = BAKED_FONT_SIZE_COUNT;
+    copy(bakedFontSizes, bakedFontSizes + BAKED_FONT_SIZE_COUNT, fontAtlas.sizes);
+    fontAtlas.width = BAKED_FONT_ATLAS_WIDTH;
+    fontAtlas.height = BAKED_FONT_ATLAS_HEIGHT;
+    fontAtlas.coverage.assign(bakedFontCoverage, bakedFontCoverage + BAKED_FONT_ATLAS_WIDTH * BAKED_FONT_ATLAS_HEIGHT);
+#else
+    // All sizes are baked in one job: FreeType must not be used from two threads at once. The
+    // fonts are closed again straight away; only the glyph atlas is kept.
+    fontJob = loader.add([this]
+                         {
+                             for (int i = 0; i < FONT_COUNT; ++i)
+                             {
+                                 TTF_Font *font = loadFont("assets/Silkscreen-Regular.ttf", fontSizes[i]);
+                                 bakeFontSize(font, fontSizes[i], fontAtlas);
+                                 TTF_CloseFont(font);
+                             }
+                         });
+#endif
+    for (int i = 0; i < SPRITE_COUNT; ++i)
+    {
+        spriteJobs[i] = spritePaths[i] ? loader.add([this, i]
+                                                    { spriteSurfaces[i] = loadImage(spritePaths[i]); })
+                                       : -1;
+    }
+
+    wakeEvent = SDL_RegisterEvents(1);
+    int threads = min(ASSET_LOADER_MAX_THREADS, max(1, SDL_GetCPUCount()));
+    loader.start(threads, wakeEvent);
+}
+
+// Starts audio once the first frame is up, so opening the device does not delay the window.
+// Sounds and music are decoded for the format the device actually opened with, so their jobs
+// only start now, on a second loader.
+void Game::openAudio()
+{
+    audioOpen = true;
+    // Replays only render video, which has no audio track: no device is opened and no sound or
+    // music is decoded, so farm children never touch the music cache. With no audio jobs added,
+    // pollAssets() sees sounds and music as done straight away.
+    if (options.replayPath)
+    {
+        startup.mark("audio skipped");
+        return;
+    }
+    // Low latency by default: start from the smallest buffer, or from the size an earlier session
+    // settled on after underruns. --audio-buffer fixes the size and turns the tuning off.
+    int bufferFrames = options.audioBuffer;
+    if (bufferFrames <= 0)
+    {
+        bufferFrames = AUDIO_BUFFER_MIN;
+        ifstream saved(prefPath("audio-buffer.txt"));
+        saved >> bufferFrames >> audioCleanSessions;
+        bufferFrames = min(AUDIO_BUFFER_MAX, max(AUDIO_BUFFER_MIN, bufferFrames));
+    }
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0 || !openMixer(bufferFrames))
+    {
+        cerr << "SDL_mixer could not initialize! SDL_mixer Error: " << Mix_GetError() << endl;
+    }
+    else
+    {
+        soundJob = audioLoader.add([this]
+                                   {
+                                       circlePickupSound = loadSound("assets/sfx/circle_pickup.wav");
+                                       deathSound = loadSound("assets/sfx/death-car.wav");
+                                       circleMissSound = loadSound("assets/sfx/circle_miss.wav");
+                                   });
+        musicJob = audioLoader.add([this]
+                                   { prepareMusic("assets/sfx/background-music.mp3"); });
+    }
+    startup.mark("audio open");
+    audioLoader.start(1, wakeEvent);
+}
+
+bool Game::openMixer(int bufferFrames)
+{
+    if (Mix_OpenAudio(PACK_AUDIO_FREQUENCY, MIX_DEFAULT_FORMAT, PACK_AUDIO_CHANNELS, bufferFrames) < 0)
+    {
+        return false;
+    }
+    audio.start(bufferFrames);
+    return true;
+}
+
+// Every few seconds: with automatic sizing, repeated underruns double the buffer. The device is
+// reopened at once outside gameplay and on the next menu or death screen otherwise, so a run is
+// never cut into; the size is kept for the next session.
+void Game::checkAudio()
+{
+    if (!audioOpen || audio.bufferFrames == 0 || SDL_GetTicks() - lastAudioCheck < AUDIO_CHECK_INTERVAL)
+    {
+        return;
+    }
+    lastAudioCheck = SDL_GetTicks();
+    int underruns = audio.takeUnderruns();
+    audioUnderran = audioUnderran || underruns >= AUDIO_UNDERRUN_LIMIT;
+    if (options.audioBuffer <= 0 && underruns >= AUDIO_UNDERRUN_LIMIT && audio.bufferFrames < AUDIO_BUFFER_MAX)
+    {
+        audioGrowPending = true;
+        if (options.cpuReport)
+        {
+            cout << "[audio] " << underruns << " underruns with " << audio.bufferFrames << " frames, growing the buffer" << endl;
+        }
+    }
+    if (audioGrowPending && currentState != NORMAL_MODE)
+    {
+        audioGrowPending = false;
+        reopenAudio(audio.bufferFrames * 2);
+    }
+}
+
+// Loaded chunks stay valid across a reopen because the format is the same; the music carries on
+// from where it was.
+void Game::reopenAudio(int bufferFrames)
+{
+    double musicPosition = backgroundMusic ? Mix_GetMusicPosition(backgroundMusic.get()) : -1;
+    bool musicPlaying = Mix_PlayingMusic();
+    bool streaming = music.isPlaying();
+    music.stop();
+    audio.stop();
+    Mix_CloseAudio();
+    if (!openMixer(bufferFrames))
+    {
+        cerr << "SDL_mixer could not reopen audio! SDL_mixer Error: " << Mix_GetError() << endl;
+        return;
+    }
+    if (streaming)
+    {
+        music.play();
+    }
+    if (musicPlaying && Mix_PlayMusic(backgroundMusic.get(), -1) == 0 && musicPosition > 0)
+    {
+        Mix_SetMusicPosition(musicPosition);
+    }
+    audioCleanSessions = 0;
+    saveAudioBuffer(bufferFrames);
+}
+
+// The saved file holds the buffer size and how many clean sessions in a row have used it.
+void Game::saveAudioBuffer(int bufferFrames)
+{
+    ofstream saved(prefPath("audio-buffer.txt"));
+    saved << bufferFrames << " " << audioCleanSessions << endl;
+}
+
+// Picks up finished jobs on the main thread: the menu text as soon as the fonts are in, then the
+// sprite atlas, then the music. Gameplay stays locked until everything has arrived. Without
+// audio (replays) there are no sound or music jobs, so that group counts as done once opened.
+void Game::pollAssets()
+{
+    if (!menuReady && loader.done(fontJob))
+    {
+        buildMenuText();
+        menuReady = true;
+        needsRedraw = true;
+        startup.mark("menu text");
+    }
+    if (!atlasReady)
+    {
+        bool decoded = true;
+        for (int i = 0; i < SPRITE_COUNT; ++i)
+        {
+            decoded = decoded && loader.done(spriteJobs[i]);
+        }
+        if (decoded)
+        {
+            buildAtlas();
+            atlasReady = true;
+            startup.mark("sprite atlas");
+        }
+    }
+    if (!musicStarted && audioOpen && audioLoader.done(soundJob) && audioLoader.done(musicJob))
+    {
+        musicStarted = true;
+        startup.mark("sounds and music");
+        if (music.isOpen() && !options.headless)
+        {
+            music.play();
+        }
+        else if (backgroundMusic && !options.headless && Mix_PlayMusic(backgroundMusic.get(), -1) == -1)
+        {
+            cerr << "Failed to play background music! SDL_mixer Error: " << Mix_GetError() << endl;
+        }
+    }
+    if (!assetsReady && menuReady && atlasReady && musicStarted && loader.allDone())
+    {
+        loader.wait();
+        audioLoader.wait();
+        assetsReady = true;
+        startup.report(firstFrameMs);
+        if (options.cpuReport || resources.budget > 0)
+        {
+            resources.report("loaded");
+        }
+    }
+}
+
+void Game::waitForAssets()
+{
+    if (!audioOpen)
+    {
+        openAudio();
+    }
+    loader.wait();
+    audioLoader.wait();
+    pollAssets();
+}
+
+void Game::buildMenuText()
+{
+    if (text.init(backend, resources, fontAtlas))
+    {
+        titleLabel = text.makeLabel(FONT_TITLE, "Two Cars Game");
+        titleTextRect = {SCREEN_WIDTH / 2 - titleLabel.w / 2, SCREEN_HEIGHT / 3 - titleLabel.h / 2, titleLabel.w, titleLabel.h};
+        playLabel1 = text.makeLabel(FONT_MENU, "Press Any Key");
+        playTextRect1 = {SCREEN_WIDTH / 2 - playLabel1.w / 2, SCREEN_HEIGHT / 2 - playLabel1.h, playLabel1.w, playLabel1.h};
+        playLabel2 = text.makeLabel(FONT_MENU, "to Play");
+        playTextRect2 = {SCREEN_WIDTH / 2 - playLabel2.w / 2, SCREEN_HEIGHT / 2, playLabel2.w, playLabel2.h};
+
+        // Death screen and HUD text never changes apart from the numbers.
+        restartLabel = text.makeLabel(FONT_TITLE, "Restart (R)");
+        homeLabel = text.makeLabel(FONT_TITLE, "Home (H)");
+        scoreLabel = text.makeLabel(FONT_TITLE, "Score: ");
+        highscoreLabel = text.makeLabel(FONT_TITLE, "Highscore: ");
+    }
+    fontAtlas.coverage = vector<uint8_t>();
+    playTextYPosition = playTextRect1.y;
+    initialPlayTextYPosition = playTextRect1.y;
+    playTextDirection = 1;
+}
+
+void Game::buildAtlas()
+{
+    spriteSurfaces[SPRITE_PARTICLE] = makeParticleSurface();
+    if (spriteSurfaces[SPRITE_ICON] && window)
+    {
+        SDL_SetWindowIcon(window, spriteSurfaces[SPRITE_ICON]);
+    }
+    // Bake the sprites for the real pixel density, e.g. 2x on a high-DPI display.
+    int windowWidth = SCREEN_WIDTH, outputWidth = SCREEN_WIDTH;
+    if (window)
+    {
+        SDL_GetWindowSize(window, &windowWidth, NULL);
+        backend->outputSize(&outputWidth, NULL);
+    }
+    float dpiScale = min(4.0f, max(1.0f, (float)outputWidth / max(1, windowWidth)));
+    if (!atlas.build(backend, resources, spriteSurfaces, dpiScale))
+    {
+        isRunning = false;
+    }
+    else if (options.cpuReport)
+    {
+        cout << "[atlas] sprites baked at " << dpiScale << "x for a " << outputWidth << " pixel wide output" << endl;
+    }
+    for (int i = 0; i < SPRITE_COUNT; ++i)
+    {
+        SDL_FreeSurface(spriteSurfaces[i]);
+        spriteSurfaces[i] = nullptr;
+    }
+}
+
+string Game::assetPath(const char *name)
+{
+    return basePath + name;
+}
+
+// Packed images are already RGBA32; the surface borrows the mapped pixels.
+SDL_Surface *Game::loadImage(const char *name)
+{
+    const PackEntry *entry = pack.find(name);
+    if (entry && entry->type == PACK_IMAGE)
+    {
+        return SDL_CreateRGBSurfaceWithFormatFrom((void *)pack.data(entry), entry->info[0], entry->info[1], 32,
+                                                  entry->info[2], SDL_PIXELFORMAT_RGBA32);
+    }
+    return IMG_Load(assetPath(name).c_str());
+}
+
+// Packed sounds already match the mixer and play straight from the mapping. If the device
+// came up in another format they are converted once into a buffer the chunk owns.
+SoundHandle Game::loadSound(const char *name)
+{
+    const PackEntry *entry = pack.find(name);
+    if (!entry || entry->type != PACK_SOUND)
+    {
+        return resources.sound(name, Mix_LoadWAV(assetPath(name).c_str()));
+    }
+    int frequency = 0, channels = 0;
+    Uint16 format = 0;
+    if (!Mix_QuerySpec(&frequency, &format, &channels))
+    {
+        return SoundHandle();
+    }
+    if (frequency == (int)entry->info[0] && format == entry->info[1] && channels == (int)entry->info[2])
+    {
+        return resources.sound(name, Mix_QuickLoad_RAW((Uint8 *)pack.data(entry), (Uint32)entry->size));
+    }
+
+    SDL_AudioCVT cvt;
+    if (SDL_BuildAudioCVT(&cvt, entry->info[1], entry->info[2], entry->info[0], format, channels, frequency) < 0)
+    {
+        cerr << "Cannot convert " << name << "! SDL Error: " << SDL_GetError() << endl;
+        return SoundHandle();
+    }
+    cvt.len = (int)entry->size;
+    cvt.buf = (Uint8 *)SDL_malloc((size_t)cvt.len * max(1, cvt.len_mult));
+    if (!cvt.buf)
+    {
+        return SoundHandle();
+    }
+    memcpy(cvt.buf, pack.data(entry), cvt.len);
+    if (SDL_ConvertAudio(&cvt) != 0)
+    {
+        SDL_free(cvt.buf);
+        return SoundHandle();
+    }
+    Mix_Chunk *chunk = Mix_QuickLoad_RAW(cvt.buf, cvt.len_cvt);
+    if (!chunk)
+    {
+        SDL_free(cvt.buf);
+        return SoundHandle();
+    }
+    chunk->allocated = 1; // Mix_FreeChunk frees the converted samples
+    return resources.sound(name, chunk);
+}
+
+#ifndef BAKED_FONT
+TTF_Font *Game::loadFont(const char *name, int size)
+{
+    const PackEntry *entry = pack.find(name);
+    if (entry && entry->type == PACK_BLOB)
+    {
+        return TTF_OpenFontRW(SDL_RWFromConstMem(pack.data(entry), (int)entry->size), 1, size);
+    }
+    return TTF_OpenFont(assetPath(name).c_str(), size);
+}
+#endif
+
+// The music is still decoded while it plays, but reads its bytes from the mapping.
+MusicHandle Game::loadMusic(const char *name)
+{
+    const PackEntry *entry = pack.find(name);
+    if (entry && entry->type == PACK_BLOB)
+    {
+        return resources.music(name, Mix_LoadMUS_RW(SDL_RWFromConstMem(pack.data(entry), (int)entry->size), 1), entry->size);
+    }
+    error_code error;
+    size_t size = filesystem::file_size(assetPath(name), error);
+    return resources.music(name, Mix_LoadMUS(assetPath(name).c_str()), error ? 0 : size);
+}
+
+// Streams the music from the PCM cache, decoding the MP3 into it first when there is no cache for
+// this source and device format yet. Without a cache (it could not be written) the MP3 is
+// played through SDL_mixer as before.
+void Game::prepareMusic(const char *name)
+{
+    const PackEntry *entry = pack.find(name);
+    SDL_RWops *source = entry && entry->type == PACK_BLOB ? SDL_RWFromConstMem(pack.data(entry), (int)entry->size)
+                                                          : SDL_RWFromFile(assetPath(name).c_str(), "rb");
+    Uint32 sourceHash = source ? MusicStream::hash(source) : 0;
+    string cachePath = prefPath("music.pcm");
+    if (source && !music.open(resources, cachePath, sourceHash))
+    {
+        Uint64 start = SDL_GetPerformanceCounter();
+        Mix_Chunk *decoded = Mix_LoadWAV_RW(source, 0);
+        // If the rename lost to another instance writing the same cache, theirs is just as good.
+        MusicStream::write(cachePath, decoded, sourceHash);
+        if (!music.open(resources, cachePath, sourceHash))
+        {
+            cerr << "Could not cache decoded music in " << cachePath << "; decoding it while playing instead" << endl;
+        }
+        else if (options.startupReport || options.cpuReport)
+        {
+            cout << "[music] decoded " << name << " into " << cachePath << " in "
+                 << (double)(SDL_GetPerformanceCounter() - start) * 1000 / SDL_GetPerformanceFrequency() << " ms" << endl;
+        }
+        Mix_FreeChunk(decoded);
+    }
+    if (source)
+    {
+        SDL_RWclose(source);
+    }
+    if (!music.isOpen())
+    {
+        backgroundMusic = loadMusic(name);
+    }
+}
+
+// ============================= GAMEPLAY UPDATES ============================= //
+// Advances the simulation by one tick and turns what happened into sounds and state changes.
+// Spawning, movement, collisions and difficulty all live in simulation.h.
+void Game::updateGameplay()
+{
+    sim.step();
+    view.capture(sim);
+    roadScroll = (roadScroll + sim.obstacleSpeed) % ROAD_DASH_PERIOD;
+    updateParticles();
+    playSounds(sim.events, sim.tick);
+
+    if (sim.dead)
+    {
+        enterDeathScreen();
+    }
+}
+
+// Steering goes to the simulation thread when it runs, otherwise straight into the simulation.
+void Game::steer(bool red)
+{
+    if (simThread)
+    {
+        steerQueue.push(red);
+    }
+    else
+    {
+        applySteer(red);
+    }
+}
+
+// Records the press in the session at the tick it takes effect, then steers.
+void Game::applySteer(bool red)
+{
+    session.steers.push_back({sim.tick, red});
+    if (red)
+    {
+        sim.steerRed();
+    }
+    else
+    {
+        sim.steerBlue();
+    }
+}
+
+// Runs on whichever thread steps the simulation, right after the tick the events happened on.
+void Game::playSounds(const SimEvents &events, int tick)
+{
+    for (int i = 0; i < events.pickups; ++i)
+    {
+        playSound(circlePickupSound, tick, SFX_LOW);
+    }
+    for (int i = 0; i < events.crashes; ++i)
+    {
+        playSound(deathSound, tick, SFX_HIGH);
+    }
+    for (int i = 0; i < events.misses; ++i)
+    {
+        playSound(circleMissSound, tick, SFX_LOW);
+    }
+}
+
+void Game::playSound(const SoundHandle &sound, int tick, int priority)
+{
+    if (sound)
+    {
+        audio.play(sound.get(), tick, priority);
+    }
+}
+
+void Game::enterDeathScreen()
+{
+    endSession();
+    currentState = DEATH_SCREEN;
+    deathScreenValid = false;
+    hoveredButton = BUTTON_NONE;
+    if (sim.score > highscore)
+    {
+        highscore = sim.score;
+        saveHighscore();
+    }
+}
+
+// ============================= THREADED GAMEPLAY ============================= //
+// Takes the newest snapshot from the simulation thread, if there is one, and catches the road
+// and particles up by however many ticks it advanced. Once the run ends the thread has
+// stopped and the simulation is back on this thread for the death screen.
+void Game::updateFromSimThread()
+{
+    if (!simThread)
+    {
+        startSimThread();
+    }
+    const GameSnapshot *latest = snapshots.acquire();
+    if (!latest)
+    {
+        return;
+    }
+    int ticks = latest->tick - view.tick;
+    view = *latest;
+    roadScroll = (roadScroll + ticks * view.obstacleSpeed) % ROAD_DASH_PERIOD;
+    updateParticles(ticks);
+
+    if (view.dead)
+    {
+        stopSimThread();
+        enterDeathScreen();
+    }
+}
+
+void Game::startSimThread()
+{
+    snapshots.reset();
+    SDL_AtomicSet(&simStopping, 0);
+    simThread = SDL_CreateThread(simulationThread, "Simulation", this);
+    if (!simThread)
+    {
+        cerr << "Could not start the simulation thread! SDL Error: " << SDL_GetError() << endl;
+        options.simThread = false;
+    }
+}
+
+void Game::stopSimThread()
+{
+    if (!simThread)
+        return;
+    SDL_AtomicSet(&simStopping, 1);
+    SDL_WaitThread(simThread, NULL);
+    simThread = nullptr;
+    bool red;
+    while (steerQueue.pop(red))
+    {
+    }
+}
+
+int Game::simulationThread(void *data)
+{
+    static_cast<Game *>(data)->runSimulation();
+    return 0;
+}
+
+// Steps the simulation against an absolute schedule so ticks stay evenly spaced. After a long
+// stall (a debugger, a dragged window) the schedule restarts instead of catching up in a burst.
+// Sounds are started here, so they stay in time with the simulation rather than the frames.
+void Game::runSimulation()
+{
+    GameSnapshot staging = view;
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 period = frequency / TICKS_PER_SECOND;
+    Uint64 next = SDL_GetPerformanceCounter();
+    while (!SDL_AtomicGet(&simStopping) && !sim.dead)
+    {
+        bool red;
+        while (steerQueue.pop(red))
+        {
+            applySteer(red);
+        }
+        sim.step();
+        playSounds(sim.events, sim.tick);
+        staging.capture(sim);
+        snapshots.back() = staging;
+        snapshots.publish();
+
+        next += period;
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (now > next + 4 * period)
+        {
+            next = now;
+        }
+        else if (next > now)
+        {
+            // Rounded up to whole milliseconds, so a tick is never early and nothing spins.
+            SDL_Delay((Uint32)(((next - now) * 1000 + frequency - 1) / frequency));
+        }
+    }
+}
+
+// Turns new pickups and crashes into particle bursts, leaves trails behind steering cars and
+// integrates the pool by the given number of ticks. Under --particle-stress the pool is topped
+// up to the requested size.
+void Game::updateParticles(int ticks)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+    const SDL_Color red = {240, 70, 80, 255}, blue = {70, 150, 255, 255}, white = {255, 255, 255, 255};
+    for (int i = max(lastHitSeen, view.hitTotal - SNAPSHOT_HIT_LOG); i < view.hitTotal; ++i)
+    {
+        const Obstacle &hit = view.hitLog[i % SNAPSHOT_HIT_LOG];
+        float cx = hit.rect.x + hit.rect.w * 0.5f, cy = hit.rect.y + hit.rect.h * 0.5f;
+        if (hit.isBox())
+        {
+            particles.burst(cx, cy, 48, 9, 0.35f, 50, 10, hit.isRed() ? red : blue);
+            particles.burst(cx, cy, 16, 6, 0.2f, 30, 6, white);
+        }
+        else
+        {
+            particles.burst(cx, cy, 24, 5, 0, 25, 6, hit.isRed() ? red : blue);
+        }
+    }
+    lastHitSeen = view.hitTotal;
+    for (const SimCar *car : {&view.blueCar, &view.redCar})
+    {
+        if (car->moving)
+        {
+            float speed = (float)view.obstacleSpeed;
+            particles.spawn(car->rect.x + car->rect.w * 0.5f, (float)(car->rect.y + car->rect.h), 0, speed, 0, 12, 8, {255, 255, 255, 110});
+        }
+    }
+    if (options.particleStress > 0)
+    {
+        uniform_real_distribution<float> across(0, SCREEN_WIDTH), down(0, SCREEN_HEIGHT), lifetime(60, 180);
+        while (particles.live() < options.particleStress &&
+               particles.spawn(across(stressRng), down(stressRng), 0, 0, 0.05f, lifetime(stressRng), PARTICLE_SIZE, stressRng() % 2 ? red : blue))
+        {
+        }
+    }
+    for (int i = 0; i < min(ticks, 4); ++i)
+    {
+        particles.update();
+    }
+    profiler.addSection(PROFILE_PARTICLE_UPDATE, (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+}
+
+// Maps an obstacle kind to the sprite it is drawn with.
+SpriteId Game::obstacleSprite(ObstacleKind kind)
+{
+    switch (kind)
+    {
+    case RED_BOX:
+        return SPRITE_BOX_RED;
+    case RED_CIRCLE:
+        return SPRITE_CIRCLE_RED;
+    case BLUE_BOX:
+        return SPRITE_BOX_BLUE;
+    default:
+        return SPRITE_CIRCLE_BLUE;
+    }
+}
+
+// ============================ HANDLING USER INTERACTION ============================ //
+// Handles any type of event from the user in all states of the game.
+// Idle screens pass a timeout so the loop sleeps in SDL_WaitEventTimeout instead of spinning.
+// Every queued event is handled, not just the first one.
+void Game::handleEvents(int timeout)
+{
+    // Time spent waiting here counts towards the state we are waiting in.
+    profiler.sample(currentState);
+
+    SDL_Event event;
+    int pending = timeout > 0 ? SDL_WaitEventTimeout(&event, timeout) : SDL_PollEvent(&event);
+    while (pending)
+    {
+        handleEvent(event);
+        pending = SDL_PollEvent(&event);
+    }
+}
+
+// How long the loop may sleep waiting for input: not at all while playing or when a frame
+// is due, until the next animation step in the menu, and in one-second slices on the
+// death screen, which only changes when the player does something.
+int Game::idleTimeout()
+{
+    if (currentState == NORMAL_MODE || needsRedraw)
+        return 0;
+    if (currentState == MAIN_MENU)
+    {
+        int wait = (int)(lastMenuStep + 1000 / options.menuFps) - (int)SDL_GetTicks();
+        return max(wait, 0);
+    }
+    return 1000;
+}
+
+void Game::handleEvent(const SDL_Event &event)
+{
+    if (event.type != SDL_MOUSEMOTION)
+    {
+        needsRedraw = true;
+    }
+
+    switch (event.type)
+    {
+    case SDL_QUIT:
+        isRunning = false;
+        break;
+    case SDL_RENDER_TARGETS_RESET:
+        // Render target contents are lost when the graphics device resets them.
+        buildBackground();
+        deathScreenValid = false;
+        break;
+    case SDL_KEYDOWN:
+        if (currentState == MAIN_MENU && assetsReady)
+        {
+            currentState = NORMAL_MODE;
+            resetCars();
+        }
+        else if (currentState == NORMAL_MODE)
+        {
+            if (event.key.keysym.sym == SDLK_ESCAPE)
+            {
+                stopSimThread();
+                endSession();
+                currentState = MAIN_MENU;
+                resetCars();
+            }
+            else if (event.key.keysym.sym == SDLK_a)
+            {
+                steer(false);
+            }
+            else if (event.key.keysym.sym == SDLK_d)
+            {
+                steer(true);
+            }
+        }
+        else if (currentState == DEATH_SCREEN)
+        {
+            if (event.key.keysym.sym == SDLK_r)
+            {
+                currentState = NORMAL_MODE;
+                resetCars();
+            }
+            else if (event.key.keysym.sym == SDLK_h)
+            {
+                currentState = MAIN_MENU;
+                resetCars();
+            }
+        }
+        break;
+    case SDL_MOUSEBUTTONDOWN:
+        if (currentState == MAIN_MENU && assetsReady)
+        {
+            currentState = NORMAL_MODE;
+            resetCars();
+        }
+        else if (currentState == DEATH_SCREEN)
+        {
+            int button = buttonAt(event.button.x, event.button.y);
+            if (button == BUTTON_RESTART)
+            {
+                currentState = NORMAL_MODE;
+                resetCars();
+            }
+            else if (button == BUTTON_HOME)
+            {
+                currentState = MAIN_MENU;
+                resetCars();
+            }
+        }
+        break;
+    case SDL_MOUSEMOTION:
+        if (currentState == DEATH_SCREEN)
+        {
+            int button = buttonAt(event.motion.x, event.motion.y);
+            if (button != hoveredButton)
+            {
+                hoveredButton = button;
+                needsRedraw = true;
+            }
+        }
+        break;
+    }
+}
+
+// ============================== UPDATING ENTITIES ============================= //
+// Updates anything in the game before rendering.
+void Game::update()
+{
+    if (!assetsReady)
+    {
+        pollAssets();
+    }
+    checkAudio();
+    if (currentState == NORMAL_MODE)
+    {
+        if (options.simThread)
+        {
+            updateFromSimThread();
+        }
+        else
+        {
+            updateGameplay();
+        }
+        needsRedraw = true;
+    }
+    else if (currentState == MAIN_MENU && SDL_GetTicks() - lastMenuStep >= (Uint32)(1000 / options.menuFps))
+    {
+        updateMenuAnimation();
+        lastMenuStep = SDL_GetTicks();
+        needsRedraw = true;
+    }
+}
+
+// ============================= MENU ANIMATION ============================= //
+// Animates the "Press Any Key" text in the menu by moving it up and down.
+// At reduced menu frame rates each step covers more pixels so the speed stays the same.
+void Game::updateMenuAnimation()
+{
+    int stepsPerFrame = max(1, 60 / options.menuFps);
+    playTextYPosition += textSpeed * playTextDirection * stepsPerFrame;
+    // Larger steps can overshoot the ends, so clamp to keep the swing at +-animationRange.
+    if (playTextYPosition <= initialPlayTextYPosition - animationRange || playTextYPosition >= initialPlayTextYPosition + animationRange)
+    {
+        playTextYPosition = min(initialPlayTextYPosition + animationRange, max(initialPlayTextYPosition - animationRange, playTextYPosition));
+        playTextDirection *= -1;
+    }
+    playTextRect1.y = playTextYPosition;
+    playTextRect2.y = playTextYPosition + playTextRect1.h;
+}
+
+// ============================== ROAD BACKGROUND ============================== //
+// The playfield (lanes, dividers and dashed lane markings) is drawn once into a texture that
+// is one dash period taller than the screen. Every frame shows a screen-sized window of it,
+// offset by how far the road has scrolled, so the background costs a single textured quad.
+void Game::drawRoad(int top, int height)
+{
+    SDL_Rect area = {0, 0, SCREEN_WIDTH, height};
+    backend->fillRect(&area, {37, 51, 122, 255});
+
+    // The lines are one-pixel-wide rectangles, which every backend fills the same way.
+    SDL_Color lineColor = {117, 138, 219, 255};
+    SDL_Rect divider = {2 * LANE_WIDTH - 2, 0, 5, height};
+    backend->fillRect(&divider, lineColor);
+    for (int y = top; y < height; y += ROAD_DASH_PERIOD)
+    {
+        SDL_Rect dash = {LANE_WIDTH, y, 1, ROAD_DASH_LENGTH};
+        backend->fillRect(&dash, lineColor);
+        dash.x = 3 * LANE_WIDTH;
+        backend->fillRect(&dash, lineColor);
+    }
+}
+
+// Renders the road into its target texture; falls back to drawing it every frame
+// when the renderer has no render-target support.
+void Game::buildBackground()
+{
+    if (!background)
+    {
+        background = resources.texture("road", backend->createTarget(SCREEN_WIDTH, SCREEN_HEIGHT + ROAD_DASH_PERIOD));
+    }
+    if (background)
+    {
+        backend->setTarget(background.get());
+        drawRoad(0, SCREEN_HEIGHT + ROAD_DASH_PERIOD);
+        backend->setTarget(nullptr);
+    }
+}
+
+// ============================== RENDERING ============================== //
+// Rendersing everything on the game in its different states.
+// Only draws when something changed, so idle screens are presented once and then left alone.
+void Game::render()
+{
+    if (!needsRedraw)
+    {
+        return;
+    }
+    needsRedraw = false;
+
+    draw();
+    if (recorder.active())
+    {
+        double readbackMs = recorder.capture(backend);
+        if (readbackMs > 0)
+        {
+            profiler.addSection(PROFILE_READBACK, readbackMs);
+        }
+    }
+    backend->present();
+    profiler.countPresent();
+
+    if (!audioOpen && menuReady)
+    {
+        firstFrameMs = startup.elapsed();
+        startup.mark("first frame");
+        openAudio();
+    }
+}
+
+// Draws the current state into the back buffer (or the headless frame surface).
+void Game::draw()
+{
+    backend->clear({37, 51, 122, 255});
+
+    if (currentState == MAIN_MENU)
+    {
+        if (menuReady)
+        {
+            renderMenu();
+        }
+    }
+    else if (currentState == NORMAL_MODE)
+    {
+        renderGameplay();
+    }
+    else if (currentState == DEATH_SCREEN)
+    {
+        if (!deathScreenValid)
+        {
+            captureDeathScreen();
+        }
+        if (deathScreenValid)
+        {
+            backend->copy(deathScreen.get(), NULL, NULL);
+        }
+        else
+        {
+            renderGameplay();
+            renderDeathScreen();
+        }
+        renderButtonHighlight();
+    }
+}
+
+// Renders the road, cars, obstacles and score counter.
+void Game::renderGameplay()
+{
+    // The road is one textured quad; scrolling just moves the source rectangle.
+    if (background)
+    {
+        SDL_Rect src = {0, ROAD_DASH_PERIOD - roadScroll, SCREEN_WIDTH, SCREEN_HEIGHT};
+        backend->copy(background.get(), &src, NULL);
+    }
+    else
+    {
+        drawRoad(roadScroll - ROAD_DASH_PERIOD, SCREEN_HEIGHT);
+    }
+
+    // Cars and obstacles all come from the atlas, so they go out as one draw call. Tilted cars
+    // use their pre-rotated variants, so nothing is rotated while drawing.
+    batch.begin(backend, atlas.texture.get());
+    SDL_Rect blueRect = {view.blueCar.rect.x, view.blueCar.rect.y, view.blueCar.rect.w, view.blueCar.rect.h};
+    SDL_Rect redRect = {view.redCar.rect.x, view.redCar.rect.y, view.redCar.rect.w, view.redCar.rect.h};
+    SDL_Rect src, dst;
+    atlas.tilted(SPRITE_CAR_BLUE, view.blueCar.angle, blueRect, src, dst);
+    batch.add(src, dst);
+    atlas.tilted(SPRITE_CAR_RED, view.redCar.angle, redRect, src, dst);
+    batch.add(src, dst);
+
+    for (int i = 0; i < view.obstacleCount; ++i)
+    {
+        const Obstacle &obstacle = view.obstacles[i];
+        SDL_Rect destRect = {obstacle.rect.x, obstacle.rect.y, obstacle.rect.w, obstacle.rect.h};
+        batch.add(atlas.rects[obstacleSprite(obstacle.kind)], destRect);
+    }
+    batch.flush();
+
+    // Particles come from the same atlas, drawn in their own batches over the sprites.
+    Uint64 particleStart = SDL_GetPerformanceCounter();
+    particles.draw(batch, atlas.rects[SPRITE_PARTICLE]);
+    batch.flush();
+    profiler.addSection(PROFILE_PARTICLE_DRAW, (SDL_GetPerformanceCounter() - particleStart) * 1000.0 / SDL_GetPerformanceFrequency());
+
+    // Live score counter, drawn from the cached digit strip.
+    text.drawNumber(batch, view.score, SCREEN_WIDTH / 2 - text.numberWidth(view.score) / 2, 10);
+}
+
+// The frozen last frame, the dark overlay and the death-screen text never change while the
+// death screen is up, so they are composited into one texture when the state is entered.
+void Game::captureDeathScreen()
+{
+    if (!deathScreen)
+    {
+        return;
+    }
+    backend->setTarget(deathScreen.get());
+    renderGameplay();
+    renderDeathScreen();
+    backend->setTarget(nullptr);
+    deathScreenValid = true;
+}
+
+// The only live part of the death screen: a highlight on the button under the mouse.
+void Game::renderButtonHighlight()
+{
+    const SDL_Rect *button = nullptr;
+    if (hoveredButton == BUTTON_RESTART)
+        button = &restartButtonRect;
+    else if (hoveredButton == BUTTON_HOME)
+        button = &homeButtonRect;
+    if (button)
+    {
+        backend->fillRect(button, {255, 255, 255, 40});
+    }
+}
+
+// Which death-screen button, if any, is at the given point.
+int Game::buttonAt(int x, int y)
+{
+    if (x >= restartButtonRect.x && x <= restartButtonRect.x + restartButtonRect.w &&
+        y >= restartButtonRect.y && y <= restartButtonRect.y + restartButtonRect.h)
+    {
+        return BUTTON_RESTART;
+    }
+    if (x >= homeButtonRect.x && x <= homeButtonRect.x + homeButtonRect.w &&
+        y >= homeButtonRect.y && y <= homeButtonRect.y + homeButtonRect.h)
+    {
+        return BUTTON_HOME;
+    }
+    return BUTTON_NONE;
+}
+
+// Renders the main menu
+void Game::renderMenu()
+{
+    text.drawLabel(batch, titleLabel, titleTextRect.x, titleTextRect.y);
+    text.drawLabel(batch, playLabel1, playTextRect1.x, playTextRect1.y);
+    text.drawLabel(batch, playLabel2, playTextRect2.x, playTextRect2.y);
+}
+
+// Renders the death screen from the glyph atlas, so nothing is rasterized while it is up.
+void Game::renderDeathScreen()
+{
+    backend->fillRect(NULL, {0, 0, 0, 200});
+
+    text.drawLabel(batch, restartLabel, restartButtonRect.x + (restartButtonRect.w - restartLabel.w) / 2, restartButtonRect.y);
+    text.drawLabel(batch, homeLabel, homeButtonRect.x + (homeButtonRect.w - homeLabel.w) / 2, homeButtonRect.y);
+
+    renderScoreLine(scoreLabel, view.score, SCREEN_HEIGHT / 2 - 100);
+    renderScoreLine(highscoreLabel, highscore, SCREEN_HEIGHT / 2 - 150);
+}
+
+// Draws a label followed by a number, centred horizontally like the old single string.
+void Game::renderScoreLine(const TextLabel &label, int value, int y)
+{
+    int x = SCREEN_WIDTH / 2 - (label.w + text.numberWidth(value)) / 2;
+    text.drawLabel(batch, label, x, y);
+    text.drawNumber(batch, value, x + label.w, y);
+}
+
+// ============================== BENCHMARK ============================== //
+// Renders a fixed, bot-driven game and reports frame times and fill rate. With --headless
+// this measures the software renderer alone; without it, the real renderer and present.
+// The highscore, sounds and game state are left untouched.
+struct FrameTimes
+{
+    vector<double> ms;
+    double pixels = 0;
+
+    void print(const char *name)
+    {
+        if (ms.empty())
+            return;
+        vector<double> sorted = ms;
+        sort(sorted.begin(), sorted.end());
+        double total = 0;
+        for (double t : ms)
+            total += t;
+        cout << "[bench] " << name << ": " << ms.size() << " frames, avg " << total / ms.size()
+             << " ms, p50 " << sorted[sorted.size() / 2] << " ms, p95 " << sorted[sorted.size() * 95 / 100]
+             << " ms, max " << sorted.back() << " ms, " << (int)(1000 * ms.size() / max(total, 1e-9)) << " fps";
+        if (pixels > 0)
+        {
+            cout << ", fill " << pixels / (total * 1000) << " Mpixel/s (" << (long)(pixels / ms.size()) << " pixels/frame)";
+        }
+        cout << endl;
+    }
+};
+
+void Game::runBenchmark()
+{
+    GameState savedState = currentState;
+    FrameTimes gameplay, menu, deathFull, deathCached;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+
+    sim.reset(1);
+    Bot blueBot, redBot;
+    BotSkill skill;
+    skill.reactionTicks = 0;
+    skill.errorRate = 0;
+    blueBot.reset(sim.blueCar, skill);
+    redBot.reset(sim.redCar, skill);
+    mt19937 botRng(1);
+
+    currentState = NORMAL_MODE;
+    for (int frame = 0; frame < options.benchFrames; ++frame)
+    {
+        if (blueBot.think(sim, sim.blueCar, false, botRng))
+            sim.steerBlue();
+        if (redBot.think(sim, sim.redCar, true, botRng))
+            sim.steerRed();
+        sim.step();
+        view.capture(sim);
+        roadScroll = (roadScroll + sim.obstacleSpeed) % ROAD_DASH_PERIOD;
+        updateParticles();
+        if (sim.dead)
+        {
+            sim.reset(frame);
+            blueBot.reset(sim.blueCar, skill);
+            redBot.reset(sim.redCar, skill);
+        }
+
+        // Pixels touched: the road, both cars and every obstacle.
+        gameplay.pixels += SCREEN_WIDTH * SCREEN_HEIGHT + 2 * CAR_WIDTH * CAR_HEIGHT + sim.obstacles.size() * OBSTACLE_SIZE * OBSTACLE_SIZE;
+        Uint64 start = SDL_GetPerformanceCounter();
+        draw();
+        backend->present();
+        gameplay.ms.push_back((SDL_GetPerformanceCounter() - start) * 1000 / frequency);
     }
-}
 
-// ============================= SPAWNING OBSTACLES ============================= //
-// Dynamically creates obstacles at random lanes with proper spacing.
-void Game::spawnObstacle()
-{
-    static int patternTimer = 0;
-    if (patternTimer == 0)
+    int screenFrames = max(1, options.benchFrames / 10);
+    for (int frame = 0; frame < screenFrames; ++frame)
     {
-        vector<int> lanes = {0, 1, 2, 3};
-        shuffle(lanes.begin(), lanes.end(), default_random_engine(random_device()()));
-
-        // Boolean values to make sure the game doesnt become impossible by spawning 2 boxes at the same time.
-        bool redBoxSpawned = false;
-        bool blueBoxSpawned = false;
-        bool redCircleSpawned = false;
-        bool blueCircleSpawned = false;
+        currentState = MAIN_MENU;
+        updateMenuAnimation();
+        Uint64 start = SDL_GetPerformanceCounter();
+        draw();
+        backend->present();
+        menu.ms.push_back((SDL_GetPerformanceCounter() - start) * 1000 / frequency);
 
-        for (int i = 0; i < 2; ++i)
+        // First death-screen frame builds the composite, later ones reuse it.
+        currentState = DEATH_SCREEN;
+        deathScreenValid = false;
+        for (int pass = 0; pass < 2; ++pass)
         {
-            Entity obstacle;
-            if (lanes[i] == 0 || lanes[i] == 1)
-            {
-                if (!redBoxSpawned && rand() % 2 == 0)
-                {
-                    obstacle.texture = redBox;
-                    redBoxSpawned = true;
-                }
-                else if (!redCircleSpawned)
-                {
-                    obstacle.texture = redCircle;
-                    redCircleSpawned = true;
-                }
-                obstacle.destRect.x = (lanes[i] == 0) ? LANE_3 : LANE_4;
-            }
-            else
-            {
-                if (!blueBoxSpawned && rand() % 2 == 0)
-                {
-                    obstacle.texture = blueBox;
-                    blueBoxSpawned = true;
-                }
-                else if (!blueCircleSpawned)
-                {
-                    obstacle.texture = blueCircle;
-                    blueCircleSpawned = true;
-                }
-                obstacle.destRect.x = (lanes[i] == 2) ? LANE_1 : LANE_2;
-            }
-            obstacle.srcRect = {0, 0, OBSTACLE_SIZE, OBSTACLE_SIZE};
-            obstacle.destRect.w = OBSTACLE_SIZE;
-            obstacle.destRect.h = OBSTACLE_SIZE;
-            obstacle.destRect.y = -obstacle.destRect.h;
-
-            if ((obstacle.texture == redBox || obstacle.texture == blueBox) && !obstacles.empty())
-            {
-                auto lastObstacle = obstacles.back();
-                if (lastObstacle.destRect.y < CAR_HEIGHT + 10)
-                {
-                    obstacle.destRect.y = lastObstacle.destRect.y - (CAR_HEIGHT + 10);
-                }
-            }
-            if ((obstacle.texture == redCircle || obstacle.texture == blueCircle) && !obstacles.empty())
-            {
-                auto lastObstacle = obstacles.back();
-                if (lastObstacle.destRect.y < CAR_HEIGHT + 10)
-                {
-                    obstacle.destRect.y = lastObstacle.destRect.y - (CAR_HEIGHT + 10);
-                }
-            }
-            obstacles.push_back(obstacle);
+            start = SDL_GetPerformanceCounter();
+            draw();
+            backend->present();
+            (pass == 0 ? deathFull : deathCached).ms.push_back((SDL_GetPerformanceCounter() - start) * 1000 / frequency);
         }
-        patternTimer = spawnRate;
-    }
-    else
-    {
-        patternTimer--;
     }
+
+    cout << "[bench] renderer: " << backend->name() << (options.headless ? ", headless" : "") << endl;
+    gameplay.print("gameplay");
+    menu.print("menu");
+    deathFull.print("death screen (composite)");
+    deathCached.print("death screen (cached)");
+
+    resetCars();
+    currentState = savedState;
+    needsRedraw = true;
 }
 
-// ============================= OBSTACLE UPDATES ============================= //
-// Moves obstacles downward and removes off-screen ones.
-// Handles game-over logic if collectible obstacles are missed.
-void Game::updateObstacles()
+// Reads the frame that was just drawn, before it is presented.
+SDL_Surface *Game::readFrame()
 {
-    for (auto &obstacle : obstacles)
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (surface && !backend->readPixels(surface->pixels, surface->pitch))
     {
-        obstacle.destRect.y += obstacleSpeed;
+        SDL_FreeSurface(surface);
+        return nullptr;
     }
-    // Destroy any obstacle that is below the screen.
-    obstacles.erase(remove_if(obstacles.begin(), obstacles.end(), [this](Entity &o)
-                              {
-                                       if (o.destRect.y > SCREEN_HEIGHT)
-                                       {
-                                           if ((o.texture == redCircle || o.texture == blueCircle) && !o.collected)
-                                           {
-                                               Mix_PlayChannel(-1, circleMissSound, 0);
-                                               currentState = DEATH_SCREEN;
-                                           }
-                                           return true;
-                                       }
-                                       return false; }),
-                    obstacles.end());
+    return surface;
 }
 
-// ============================= COLLISION DETECTION ============================= //
-// Detects collisions between cars and obstacles.
-// Updates score and transitions to game over if a collision occurs.
-void Game::checkCollision()
+// Saves one frame of each screen for automated visual checks.
+void Game::saveScreenshots()
 {
-    for (auto &obstacle : obstacles)
+    GameState savedState = currentState;
+    const GameState states[3] = {MAIN_MENU, NORMAL_MODE, DEATH_SCREEN};
+    const char *names[3] = {"menu.bmp", "play.bmp", "death.bmp"};
+
+    sim.reset(1);
+    for (int i = 0; i < 5 * TICKS_PER_SECOND && !sim.dead; ++i)
     {
-        if (SDL_HasIntersection(&redCar.destRect, &obstacle.destRect))
-        {
-            if (obstacle.texture == redBox)
-            {
-                Mix_PlayChannel(-1, deathSound, 0);
-                currentState = DEATH_SCREEN;
-            }
-            else if (obstacle.texture == redCircle && !obstacle.collected)
-            {
-                score++;
-                obstacle.collected = true;
-                Mix_PlayChannel(-1, circlePickupSound, 0);
-            }
-        }
-        if (SDL_HasIntersection(&blueCar.destRect, &obstacle.destRect))
+        sim.step();
+    }
+    view.capture(sim);
+    for (int i = 0; i < 3; ++i)
+    {
+        currentState = states[i];
+        deathScreenValid = false;
+        draw();
+        SDL_Surface *frame = readFrame();
+        string path = string(options.screenshotDir) + "/" + names[i];
+        if (!frame || SDL_SaveBMP(frame, path.c_str()) != 0)
         {
-            if (obstacle.texture == blueBox)
-            {
-                Mix_PlayChannel(-1, deathSound, 0);
-                currentState = DEATH_SCREEN;
-            }
-            else if (obstacle.texture == blueCircle && !obstacle.collected)
-            {
-                score++;
-                obstacle.collected = true;
-                Mix_PlayChannel(-1, circlePickupSound, 0);
-            }
+            cerr << "Failed to save " << path << "! SDL Error: " << SDL_GetError() << endl;
         }
+        SDL_FreeSurface(frame);
+        backend->present();
     }
-    obstacles.erase(remove_if(obstacles.begin(), obstacles.end(), [](Entity &o)
-                              { return o.collected; }),
-                    obstacles.end());
 
-    if (currentState == DEATH_SCREEN && score > highscore)
-    {
-        highscore = score;
-        saveHighscore();
-    }
+    resetCars();
+    currentState = savedState;
+    needsRedraw = true;
 }
 
-// ============================= DIFFICULTY PROGRESSION ============================= //
-// Gradually increases the spawn rate and speed of obstacles over time.
-void Game::increaseDifficulty()
+// ============================== REPLAY RENDERING ============================== //
+// Re-simulates a recorded session and renders every tick straight to a Y4M file, as fast as
+// the renderer allows. A run that ended in a crash gets one more second of the death screen.
+bool Game::renderReplay()
 {
-    static Uint32 lastIncreaseTime = 0;
-    Uint32 currentTime = SDL_GetTicks();
-    Uint32 elapsedTime = (currentTime - startTime) / 1000;
+    Session replay;
+    if (!replay.load(options.replayPath))
+    {
+        cerr << "Could not read session " << options.replayPath << endl;
+        return false;
+    }
+    if (!recorder.start(options.replayOut, SCREEN_WIDTH, SCREEN_HEIGHT))
+    {
+        return false;
+    }
 
-    if (elapsedTime % 30 == 0 && currentTime - lastIncreaseTime >= 1000)
+    SessionPlayer player;
+    player.start(replay, sim);
+    currentState = NORMAL_MODE;
+    int frame = 0;
+    while (!player.finished())
     {
-        if (spawnRate > 20)
-            spawnRate -= 20;
-        if (obstacleSpeed < 15)
-            obstacleSpeed += 2;
-        lastIncreaseTime = currentTime;
+        player.step();
+        view.capture(sim);
+        roadScroll = (roadScroll + sim.obstacleSpeed) % ROAD_DASH_PERIOD;
+        updateParticles();
+        draw();
+        recorder.capture(backend, frame++, true);
+    }
+    if (sim.dead)
+    {
+        currentState = DEATH_SCREEN;
+        deathScreenValid = false;
+        for (int i = 0; i < TICKS_PER_SECOND; ++i)
+        {
+            draw();
+            recorder.capture(backend, frame++, true);
+        }
     }
+    return recorder.stop();
 }
 
-// ============================ HANDLING USER INTERACTION ============================ //
-// Handles any type of event from the user in all states of the game.
-void Game::handleEvents()
+// ============================== RENDER FARM ============================== //
+// Renders every session in a directory to video, one headless replay process per core.
+// Separate processes keep each renderer, font and decoder on its own with nothing shared.
+struct RenderFarm
 {
-    SDL_Event event;
-    SDL_PollEvent(&event);
-    switch (event.type)
+    string program;
+    string outDir;
+    vector<string> sessions;
+    SDL_atomic_t nextSession;
+    SDL_atomic_t failures;
+};
+
+#ifdef _WIN32
+// Quotes one argument so the child's command-line parser gives it back unchanged: backslashes
+// are only special before a quote, and CreateProcess runs no shell, so % and the like stay as they are.
+wstring quoteArgument(const wstring &arg)
+{
+    if (!arg.empty() && arg.find_first_of(L" \t\n\v\"") == wstring::npos)
+        return arg;
+    wstring quoted = L"\"";
+    for (size_t i = 0;; ++i)
     {
-    case SDL_QUIT:
-        isRunning = false;
-        break;
-    case SDL_KEYDOWN:
-        if (currentState == MAIN_MENU)
-        {
-            currentState = NORMAL_MODE;
-            startTime = SDL_GetTicks();
-            resetCars();
-        }
-        else if (currentState == NORMAL_MODE)
+        size_t backslashes = 0;
+        while (i < arg.size() && arg[i] == L'\\')
         {
-            if (event.key.keysym.sym == SDLK_ESCAPE)
-            {
-                currentState = MAIN_MENU;
-                score = 0;
-                obstacles.clear();
-                spawnRate = 80;
-                obstacleSpeed = 6;
-            }
-            else if (event.key.keysym.sym == SDLK_a)
-            {
-                if (blueCar.destRect.x == LANE_1)
-                {
-                    blueCar.targetX = LANE_2;
-                }
-                else
-                {
-                    blueCar.targetX = LANE_1;
-                }
-                blueCar.moving = true;
-                blueCar.moveStartTime = SDL_GetTicks();
-                blueCar.rotating = true;
-                blueCar.rotationStartTime = SDL_GetTicks();
-            }
-            else if (event.key.keysym.sym == SDLK_d)
-            {
-                if (redCar.destRect.x == LANE_4)
-                {
-                    redCar.targetX = LANE_3;
-                }
-                else
-                {
-                    redCar.targetX = LANE_4;
-                }
-                redCar.moving = true;
-                redCar.moveStartTime = SDL_GetTicks();
-                redCar.rotating = true;
-                redCar.rotationStartTime = SDL_GetTicks();
-            }
+            ++i;
+            ++backslashes;
         }
-        else if (currentState == DEATH_SCREEN)
+        if (i == arg.size())
         {
-            if (event.key.keysym.sym == SDLK_r)
-            {
-                startTime = SDL_GetTicks();
-                currentState = NORMAL_MODE;
-                resetCars();
-            }
-            else if (event.key.keysym.sym == SDLK_h)
-            {
-                startTime = SDL_GetTicks();
-                currentState = MAIN_MENU;
-                resetCars();
-            }
+            quoted.append(backslashes * 2, L'\\');
+            break;
         }
-        break;
-    case SDL_MOUSEBUTTONDOWN:
-        if (currentState == MAIN_MENU)
+        if (arg[i] == L'"')
         {
-            currentState = NORMAL_MODE;
-            startTime = SDL_GetTicks();
-            resetCars();
+            quoted.append(backslashes * 2 + 1, L'\\');
         }
-        else if (currentState == DEATH_SCREEN)
+        else
         {
-            int x, y;
-            SDL_GetMouseState(&x, &y);
-            if (x >= restartButtonRect.x && x <= restartButtonRect.x + restartButtonRect.w &&
-                y >= restartButtonRect.y && y <= restartButtonRect.y + restartButtonRect.h)
-            {
-                currentState = NORMAL_MODE;
-                startTime = SDL_GetTicks();
-                resetCars();
-            }
-            else if (x >= homeButtonRect.x && x <= homeButtonRect.x + homeButtonRect.w &&
-                     y >= homeButtonRect.y && y <= homeButtonRect.y + homeButtonRect.h)
-            {
-                currentState = MAIN_MENU;
-                resetCars();
-            }
+            quoted.append(backslashes, L'\\');
         }
-        break;
+        quoted.push_back(arg[i]);
     }
+    quoted.push_back(L'"');
+    return quoted;
 }
 
-// ============================== UPDATING ENTITIES ============================= //
-// Updates anything in the game before rendering.
-void Game::update()
+wstring widen(const string &text)
 {
-    if (currentState == NORMAL_MODE)
+    int length = MultiByteToWideChar(CP_ACP, 0, text.c_str(), -1, NULL, 0);
+    wstring wide(max(length, 1), L'\0');
+    MultiByteToWideChar(CP_ACP, 0, text.c_str(), -1, &wide[0], length);
+    wide.resize(max(length, 1) - 1);
+    return wide;
+}
+#endif
+
+// Runs a child process from an argument list, with no shell in between, and waits for it.
+// Returns its exit status, or -1 if it could not be started at all.
+int runProcess(const vector<string> &args)
+{
+#ifdef _WIN32
+    wstring commandLine;
+    for (const string &arg : args)
     {
-        updateObstacles();
-        checkCollision();
-        increaseDifficulty();
-        spawnObstacle();
-        blueCar.updateRotation();
-        blueCar.updateMovement();
-        redCar.updateRotation();
-        redCar.updateMovement();
+        commandLine += (commandLine.empty() ? L"" : L" ") + quoteArgument(widen(arg));
     }
-    else if (currentState == MAIN_MENU)
+    STARTUPINFOW startup = {};
+    startup.cb = sizeof(startup);
+    PROCESS_INFORMATION process = {};
+    if (!CreateProcessW(NULL, &commandLine[0], NULL, NULL, FALSE, 0, NULL, NULL, &startup, &process))
+        return -1;
+    WaitForSingleObject(process.hProcess, INFINITE);
+    DWORD exitCode = 1;
+    GetExitCodeProcess(process.hProcess, &exitCode);
+    CloseHandle(process.hThread);
+    CloseHandle(process.hProcess);
+    return (int)exitCode;
+#else
+    vector<char *> argv;
+    for (const string &arg : args)
     {
-        updateMenuAnimation();
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    pid_t pid;
+    if (posix_spawnp(&pid, argv[0], NULL, NULL, argv.data(), environ) != 0)
+        return -1;
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+            return -1;
     }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + (WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+#endif
 }
 
-// ============================= MENU ANIMATION ============================= //
-// Animates the "Press Any Key" text in the menu by moving it up and down.
-void Game::updateMenuAnimation()
+int renderFarmWorker(void *data)
 {
-    playTextYPosition += textSpeed * playTextDirection;
-    if (playTextYPosition <= initialPlayTextYPosition - animationRange || playTextYPosition >= initialPlayTextYPosition + animationRange)
+    RenderFarm *farm = static_cast<RenderFarm *>(data);
+    for (int i = SDL_AtomicAdd(&farm->nextSession, 1); i < (int)farm->sessions.size(); i = SDL_AtomicAdd(&farm->nextSession, 1))
     {
-        playTextDirection *= -1;
+        const string &session = farm->sessions[i];
+        string name = filesystem::path(session).stem().string();
+        string out = (filesystem::path(farm->outDir) / (name + ".y4m")).string();
+        int status = runProcess({farm->program, "--headless", "--replay", session, "--replay-out", out});
+        if (status != 0)
+        {
+            if (status < 0)
+                cerr << "[farm] could not start " << farm->program << " for " << session << endl;
+            else
+                cerr << "[farm] failed (exit status " << status << "): " << session << endl;
+            SDL_AtomicAdd(&farm->failures, 1);
+        }
     }
-    playTextRect1.y = playTextYPosition;
-    playTextRect2.y = playTextYPosition + playTextRect1.h;
+    return 0;
 }
 
-// ============================== RENDERING ============================== //
-// Rendersing everything on the game in its different states.
-void Game::render()
+int runRenderFarm(const GameOptions &options, const char *program)
 {
-    SDL_SetRenderDrawColor(renderer, 37, 51, 122, 255);
-    SDL_RenderClear(renderer);
+    RenderFarm farm;
+    farm.program = program;
+    farm.outDir = options.farmOut;
+    SDL_AtomicSet(&farm.nextSession, 0);
+    SDL_AtomicSet(&farm.failures, 0);
 
-    if (currentState == MAIN_MENU)
-    {
-        renderMenu();
-    }
-    else if (currentState == NORMAL_MODE || currentState == DEATH_SCREEN)
+    double recordedSeconds = 0;
+    error_code error;
+    for (const auto &entry : filesystem::directory_iterator(options.farmSessions, error))
     {
-
-        SDL_SetRenderDrawColor(renderer, 117, 138, 219, 255);
-
-        SDL_RenderDrawLine(renderer, LANE_WIDTH, 0, LANE_WIDTH, SCREEN_HEIGHT);
-
-        for (int i = -2; i <= 2; ++i)
+        Session session;
+        if (entry.is_regular_file() && session.load(entry.path().string()))
         {
-            SDL_RenderDrawLine(renderer, 2 * LANE_WIDTH + i, 0, 2 * LANE_WIDTH + i, SCREEN_HEIGHT);
+            farm.sessions.push_back(entry.path().string());
+            recordedSeconds += (double)session.ticks / TICKS_PER_SECOND;
         }
-        SDL_RenderDrawLine(renderer, 3 * LANE_WIDTH, 0, 3 * LANE_WIDTH, SCREEN_HEIGHT);
-
-        SDL_RenderCopyEx(renderer, blueCar.texture, NULL, &blueCar.destRect, blueCar.angle, NULL, SDL_FLIP_NONE);
-        SDL_RenderCopyEx(renderer, redCar.texture, NULL, &redCar.destRect, redCar.angle, NULL, SDL_FLIP_NONE);
+    }
+    if (farm.sessions.empty())
+    {
+        cerr << "[farm] no sessions found in " << options.farmSessions << endl;
+        return 1;
+    }
+    filesystem::create_directories(farm.outDir, error);
 
-        for (auto &obstacle : obstacles)
-        {
-            obstacle.render(renderer);
-        }
+    int jobs = options.farmJobs > 0 ? options.farmJobs : SDL_GetCPUCount();
+    jobs = min(jobs, (int)farm.sessions.size());
+    cout << "[farm] rendering " << farm.sessions.size() << " sessions (" << recordedSeconds << " s of play) with " << jobs << " jobs" << endl;
 
-        if (currentState == DEATH_SCREEN)
-        {
-            renderDeathScreen();
-        }
+    Uint64 start = SDL_GetPerformanceCounter();
+    vector<SDL_Thread *> workers;
+    for (int i = 0; i < jobs; ++i)
+    {
+        workers.push_back(SDL_CreateThread(renderFarmWorker, "RenderFarm", &farm));
     }
+    for (SDL_Thread *worker : workers)
+    {
+        SDL_WaitThread(worker, NULL);
+    }
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
 
-    SDL_RenderPresent(renderer);
-}
-
-// Renders the main menu
-void Game::renderMenu()
-{
-    SDL_RenderCopy(renderer, titleTextTexture, NULL, &titleTextRect);
-    SDL_RenderCopy(renderer, playTextTexture1, NULL, &playTextRect1);
-    SDL_RenderCopy(renderer, playTextTexture2, NULL, &playTextRect2);
+    int failures = SDL_AtomicGet(&farm.failures);
+    cout << "[farm] " << farm.sessions.size() - failures << " rendered, " << failures << " failed in " << seconds
+         << " s (" << recordedSeconds / max(seconds, 1e-9) << "x real time)" << endl;
+    return failures == 0 ? 0 : 1;
 }
 
-// Renders the death screen
-// Todo? Match the impelementation style with the rest of the code
-void Game::renderDeathScreen()
+// ============================== RESETING CARS POSITION ============================== //
+// Reset car positions, score and difficulty after death or escape, with a fresh random seed.
+void Game::resetCars()
 {
-    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 200);
-    SDL_RenderFillRect(renderer, NULL);
-
-    SDL_Color color = {255, 255, 255, 255};
-    SDL_Surface *textSurface;
-    SDL_Texture *textTexture;
-    SDL_Rect textRect;
-
-    textSurface = TTF_RenderText_Solid(titleFont, "Restart (R)", color);
-    textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
-    textRect = {restartButtonRect.x + (restartButtonRect.w - textSurface->w) / 2, restartButtonRect.y, textSurface->w, textSurface->h};
-    SDL_FreeSurface(textSurface);
-    SDL_RenderCopy(renderer, textTexture, NULL, &textRect);
-    SDL_DestroyTexture(textTexture);
-
-    textSurface = TTF_RenderText_Solid(titleFont, "Home (H)", color);
-    textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
-    textRect = {homeButtonRect.x + (homeButtonRect.w - textSurface->w) / 2, homeButtonRect.y, textSurface->w, textSurface->h};
-    SDL_FreeSurface(textSurface);
-    SDL_RenderCopy(renderer, textTexture, NULL, &textRect);
-    SDL_DestroyTexture(textTexture);
-
-    string scoreText = "Score: " + to_string(score);
-    textSurface = TTF_RenderText_Solid(titleFont, scoreText.c_str(), color);
-    textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
-    textRect = {SCREEN_WIDTH / 2 - textSurface->w / 2, SCREEN_HEIGHT / 2 - 100, textSurface->w, textSurface->h};
-    SDL_FreeSurface(textSurface);
-    SDL_RenderCopy(renderer, textTexture, NULL, &textRect);
-    SDL_DestroyTexture(textTexture);
-
-    string highscoreText = "Highscore: " + to_string(highscore);
-    textSurface = TTF_RenderText_Solid(titleFont, highscoreText.c_str(), color);
-    textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
-    textRect = {SCREEN_WIDTH / 2 - textSurface->w / 2, SCREEN_HEIGHT / 2 - 150, textSurface->w, textSurface->h};
-    SDL_FreeSurface(textSurface);
-    SDL_RenderCopy(renderer, textTexture, NULL, &textRect);
-    SDL_DestroyTexture(textTexture);
+    sim.reset(random_device()());
+    session.begin(sim);
+    view = GameSnapshot();
+    view.capture(sim);
+    lastHitSeen = 0;
+    particles.clear();
+    if (assetsReady)
+    {
+        resources.checkGrowth();
+    }
 }
 
-// ============================== RESETING CARS POSITION ============================== //
-// Reset car positions after death or escape.
-void Game::resetCars()
+// Saves the run that just ended so it can be replayed or rendered to video later.
+void Game::endSession()
 {
-    blueCar.destRect = {LANE_1, SCREEN_HEIGHT - 100, CAR_WIDTH, CAR_HEIGHT};
-    redCar.destRect = {LANE_4, SCREEN_HEIGHT - 100, CAR_WIDTH, CAR_HEIGHT};
-    score = 0;
-    obstacles.clear();
-    spawnRate = 80;
-    obstacleSpeed = 6;
+    if (!options.sessionDir || sim.tick == 0)
+    {
+        return;
+    }
+    session.ticks = sim.tick;
+    string path = string(options.sessionDir) + "/session-" + to_string(time(nullptr)) + "-" + to_string(sessionsSaved++) + ".txt";
+    if (!session.save(path))
+    {
+        cerr << "Failed to save session " << path << endl;
+    }
 }
 
 // ============================= RESOURCE MANAGEMENT ============================= //
 // Cleans up the memory when the program closes.
 void Game::clean()
 {
-    SDL_DestroyTexture(blueCar.texture);
-    SDL_DestroyTexture(redCar.texture);
-    SDL_DestroyTexture(redBox);
-    SDL_DestroyTexture(redCircle);
-    SDL_DestroyTexture(blueBox);
-    SDL_DestroyTexture(blueCircle);
-    SDL_DestroyTexture(titleTextTexture);
-    SDL_DestroyTexture(playTextTexture1);
-    SDL_DestroyTexture(playTextTexture2);
-    TTF_CloseFont(titleFont);
-    TTF_CloseFont(menuFont);
-    Mix_FreeChunk(circlePickupSound);
-    Mix_FreeChunk(deathSound);
-    Mix_FreeChunk(circleMissSound);
-    Mix_FreeMusic(backgroundMusic);
+    profiler.sample(currentState);
+    profiler.report(true);
+    recorder.stop();
+    stopSimThread();
+    // Quitting while assets are still loading: let the jobs finish so nothing is freed under them.
+    loader.wait();
+    audioLoader.wait();
+    for (int i = 0; i < SPRITE_COUNT; ++i)
+    {
+        SDL_FreeSurface(spriteSurfaces[i]);
+    }
+    if (currentState == NORMAL_MODE)
+    {
+        endSession();
+    }
+    if (options.cpuReport || resources.budget > 0)
+    {
+        resources.report("exit");
+    }
+    // A played session (one that lasted at least one audio check) without repeated underruns
+    // counts towards halving a grown buffer, so one bad run does not keep the latency high for good.
+    if (options.audioBuffer <= 0 && !options.headless && audio.bufferFrames > 0 && lastAudioCheck > 0)
+    {
+        int bufferFrames = audio.bufferFrames;
+        bool underran = audioUnderran || audio.takeUnderruns() >= AUDIO_UNDERRUN_LIMIT;
+        audioCleanSessions = underran ? 0 : audioCleanSessions + 1;
+        if (audioCleanSessions >= AUDIO_CLEAN_SESSIONS && bufferFrames > AUDIO_BUFFER_MIN)
+        {
+            bufferFrames /= 2;
+            audioCleanSessions = 0;
+        }
+        saveAudioBuffer(bufferFrames);
+    }
+    music.stop();
+    audio.stop();
+    if (options.cpuReport && audio.bufferFrames > 0)
+    {
+        audio.report();
+        music.report();
+    }
+
+    // Everything registered goes before the renderer and mixer it belongs to; whatever is
+    // still alive after that was never released and is reported as a leak.
+    atlas.destroy();
+    text.destroy();
+    background.reset();
+    deathScreen.reset();
+    circlePickupSound.reset();
+    deathSound.reset();
+    circleMissSound.reset();
+    backgroundMusic.reset();
+    music.close();
+    resources.checkLeaks();
+
     Mix_CloseAudio();
+#ifndef BAKED_FONT
     TTF_Quit();
+#endif
+    IMG_Quit();
+    pack.close();
+    // The renderer belongs to the window, so it is destroyed first.
+    if (backend)
+    {
+        backend->destroy();
+        delete backend;
+        backend = nullptr;
+    }
     SDL_DestroyWindow(window);
-    SDL_DestroyRenderer(renderer);
+    resources.destroy();
     SDL_Quit();
     saveHighscore();
 }
 
 // ============================== HIGHSCORE MANAGEMENT ============================== //
 // Uses file i/o to save and load the highscore from player.dat with a simple XOR encoding step.
+// The file lives in the per-user data folder from SDL_GetPrefPath; a player.dat left in the
+// working directory by older versions is still read once and then saved to the new place.
+string Game::prefPath(const char *file)
+{
+    char *prefDir = SDL_GetPrefPath("TwoCars", "Two Cars Game");
+    string path = prefDir ? string(prefDir) + file : file;
+    SDL_free(prefDir);
+    return path;
+}
+
 void Game::loadHighscore()
 {
-    ifstream file("player.dat", ios::binary);
+    ifstream file(prefPath("player.dat"), ios::binary);
+    if (!file.is_open())
+    {
+        file.open("player.dat", ios::binary);
+    }
     if (file.is_open())
     {
         int encodedHighscore;
@@ -755,7 +4585,7 @@ void Game::loadHighscore()
 
 void Game::saveHighscore()
 {
-    ofstream file("player.dat", ios::binary);
+    ofstream file(prefPath("player.dat"), ios::binary);
     if (file.is_open())
     {
         int encodedHighscore = highscore ^ 0xA5A5A5A5; // Simple XOR encoding
@@ -764,6 +4594,111 @@ void Game::saveHighscore()
     }
 }
 
+// ============================= COMMAND LINE ============================= //
+// --menu-fps N         animation rate of the main menu (default 20)
+// --cpu-report         print CPU use and frame rate per game state every few seconds
+// --headless           render with the software renderer into memory, no window or display
+// --software           draw with the built-in CPU blitter instead of SDL_Renderer
+// --bench N            time N gameplay frames (plus the menu and death screen) and exit
+// --screenshots DIR    save menu.bmp, play.bmp and death.bmp into DIR and exit
+// --record FILE        record every presented frame to a Y4M video
+// --save-sessions DIR  save every run (seed and inputs) to DIR for replaying
+// --replay FILE        re-simulate a saved session and render it to --replay-out (a Y4M file)
+// --render-farm IN OUT render every session in IN to OUT, one replay process per core
+// --farm-jobs N        number of parallel replay processes (default: all cores)
+// --particle-budget N  most particles drawn per frame (default 1024)
+// --particle-stress N  keep N particles alive during play to measure the particle system
+// --sim-thread         run the simulation on its own thread; the main thread only draws
+// --startup-report     print how long each startup phase took once the game is playable
+// --memory-budget MB   report texture, sound and music memory against this budget
+// --audio-buffer N     fixed audio buffer of N frames (default: tuned between 256 and 512 on underruns)
+GameOptions parseOptions(int argc, char *argv[])
+{
+    GameOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--menu-fps" && i + 1 < argc)
+        {
+            options.menuFps = atoi(argv[++i]);
+        }
+        else if (arg == "--cpu-report")
+        {
+            options.cpuReport = true;
+        }
+        else if (arg == "--headless")
+        {
+            options.headless = true;
+        }
+        else if (arg == "--software")
+        {
+            options.softwareRenderer = true;
+        }
+        else if (arg == "--bench" && i + 1 < argc)
+        {
+            options.benchFrames = atoi(argv[++i]);
+        }
+        else if (arg == "--screenshots" && i + 1 < argc)
+        {
+            options.screenshotDir = argv[++i];
+        }
+        else if (arg == "--record" && i + 1 < argc)
+        {
+            options.recordPath = argv[++i];
+        }
+        else if (arg == "--save-sessions" && i + 1 < argc)
+        {
+            options.sessionDir = argv[++i];
+        }
+        else if (arg == "--replay" && i + 1 < argc)
+        {
+            options.replayPath = argv[++i];
+        }
+        else if (arg == "--replay-out" && i + 1 < argc)
+        {
+            options.replayOut = argv[++i];
+        }
+        else if (arg == "--render-farm" && i + 2 < argc)
+        {
+            options.farmSessions = argv[++i];
+            options.farmOut = argv[++i];
+        }
+        else if (arg == "--farm-jobs" && i + 1 < argc)
+        {
+            options.farmJobs = atoi(argv[++i]);
+        }
+        else if (arg == "--particle-budget" && i + 1 < argc)
+        {
+            options.particleBudget = atoi(argv[++i]);
+        }
+        else if (arg == "--particle-stress" && i + 1 < argc)
+        {
+            options.particleStress = atoi(argv[++i]);
+        }
+        else if (arg == "--sim-thread")
+        {
+            options.simThread = true;
+        }
+        else if (arg == "--startup-report")
+        {
+            options.startupReport = true;
+        }
+        else if (arg == "--memory-budget" && i + 1 < argc)
+        {
+            options.memoryBudget = atoi(argv[++i]);
+        }
+        else if (arg == "--audio-buffer" && i + 1 < argc)
+        {
+            options.audioBuffer = atoi(argv[++i]);
+        }
+        else
+        {
+            cerr << "Ignoring unknown option " << arg << endl;
+        }
+    }
+    return options;
+}
+
 // ============================= MAIN GAME LOOP ============================= //
 // Runs the main game loop with stable frame timing, handling events, updates, and rendering.
 Game *game = nullptr;
@@ -776,19 +4711,51 @@ int main(int argc, char *argv[])
     Uint32 frameStart;
     int frameTime;
 
-    game = new Game();
+    GameOptions options = parseOptions(argc, argv);
+    if (options.farmSessions)
+    {
+        return runRenderFarm(options, argv[0]);
+    }
+    if (options.replayPath && !options.replayOut)
+    {
+        cerr << "--replay needs --replay-out" << endl;
+        return 1;
+    }
+
+    game = new Game(options);
     game->init("Two Cars Game", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, SCREEN_WIDTH, SCREEN_HEIGHT, false);
 
+    // Replays, benchmarks and visual checks run once and exit instead of entering the game loop.
+    if (game->running() && options.replayPath)
+    {
+        bool rendered = game->renderReplay();
+        game->clean();
+        return rendered ? 0 : 1;
+    }
+    if (game->running() && (options.benchFrames > 0 || options.screenshotDir))
+    {
+        if (options.benchFrames > 0)
+        {
+            game->runBenchmark();
+        }
+        if (options.screenshotDir)
+        {
+            game->saveScreenshots();
+        }
+        game->clean();
+        return 0;
+    }
+
     while (game->running())
     {
         frameStart = SDL_GetTicks();
-        game->handleEvents();
+        game->handleEvents(game->idleTimeout());
         game->update();
         game->render();
 
-        // Limits frame rate to 60 FPS.
+        // Limits frame rate to 60 FPS while playing; idle screens sleep in handleEvents instead.
         frameTime = SDL_GetTicks() - frameStart;
-        if (frameDelay > frameTime)
+        if (!game->idle() && frameDelay > frameTime)
         {
             SDL_Delay(frameDelay - frameTime);
         }
@@ -0,0 +1,177 @@
+// ============================= ASSET PACKER ============================= //
+// Builds the asset pack the game maps at startup. PNGs are decoded to RGBA32, WAVs are
+// decoded and converted to the mixer's output format, and everything else (the font and the
+// music) is stored as it is. The game then does no decoding or file searching for them.
+//
+// Usage: packer [ASSET_DIR] [OUTPUT]
+//   ASSET_DIR   directory to pack (default "assets"); entry names start with its name,
+//               e.g. "assets/car-red.png", matching the paths the game loads
+//   OUTPUT      pack file to write (default "assets.pack"), placed next to the executable
+#include "SDL2/SDL.h"
+#include "SDL2/SDL_image.h"
+#include "assetpack.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <algorithm>
+
+using namespace std;
+
+struct PackItem
+{
+    PackEntry entry;
+    vector<uint8_t> payload;
+};
+
+// Decodes a PNG (or any format SDL_image reads) into tightly packed RGBA32 rows.
+bool packImage(const string &path, PackItem &item)
+{
+    SDL_Surface *loaded = IMG_Load(path.c_str());
+    SDL_Surface *surface = loaded ? SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0) : nullptr;
+    SDL_FreeSurface(loaded);
+    if (!surface)
+    {
+        cerr << "Could not decode " << path << ": " << IMG_GetError() << endl;
+        return false;
+    }
+    int rowBytes = surface->w * 4;
+    item.entry.type = PACK_IMAGE;
+    item.entry.info[0] = surface->w;
+    item.entry.info[1] = surface->h;
+    item.entry.info[2] = rowBytes;
+    item.payload.resize((size_t)rowBytes * surface->h);
+    for (int y = 0; y < surface->h; ++y)
+    {
+        memcpy(&item.payload[(size_t)y * rowBytes], (Uint8 *)surface->pixels + y * surface->pitch, rowBytes);
+    }
+    SDL_FreeSurface(surface);
+    return true;
+}
+
+// Decodes a WAV and converts it to the format the game opens the mixer with.
+bool packSound(const string &path, PackItem &item)
+{
+    SDL_AudioSpec spec;
+    Uint8 *buffer = nullptr;
+    Uint32 length = 0;
+    if (!SDL_LoadWAV(path.c_str(), &spec, &buffer, &length))
+    {
+        cerr << "Could not decode " << path << ": " << SDL_GetError() << endl;
+        return false;
+    }
+    SDL_AudioCVT cvt;
+    if (SDL_BuildAudioCVT(&cvt, spec.format, spec.channels, spec.freq, AUDIO_S16SYS, PACK_AUDIO_CHANNELS, PACK_AUDIO_FREQUENCY) < 0)
+    {
+        cerr << "Cannot convert " << path << ": " << SDL_GetError() << endl;
+        SDL_FreeWAV(buffer);
+        return false;
+    }
+    vector<uint8_t> converted((size_t)length * max(1, cvt.len_mult));
+    memcpy(converted.data(), buffer, length);
+    SDL_FreeWAV(buffer);
+    cvt.buf = converted.data();
+    cvt.len = length;
+    if (cvt.needed && SDL_ConvertAudio(&cvt) != 0)
+    {
+        cerr << "Cannot convert " << path << ": " << SDL_GetError() << endl;
+        return false;
+    }
+    converted.resize(cvt.needed ? cvt.len_cvt : length);
+
+    item.entry.type = PACK_SOUND;
+    item.entry.info[0] = PACK_AUDIO_FREQUENCY;
+    item.entry.info[1] = AUDIO_S16SYS;
+    item.entry.info[2] = PACK_AUDIO_CHANNELS;
+    item.payload = move(converted);
+    return true;
+}
+
+bool packBlob(const string &path, PackItem &item)
+{
+    ifstream file(path, ios::binary);
+    if (!file.is_open())
+    {
+        cerr << "Could not read " << path << endl;
+        return false;
+    }
+    item.entry.type = PACK_BLOB;
+    item.payload.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    filesystem::path assetDir = argc > 1 ? argv[1] : "assets";
+    string output = argc > 2 ? argv[2] : "assets.pack";
+
+    vector<filesystem::path> files;
+    error_code error;
+    for (const auto &entry : filesystem::recursive_directory_iterator(assetDir, error))
+    {
+        if (entry.is_regular_file())
+            files.push_back(entry.path());
+    }
+    if (error || files.empty())
+    {
+        cerr << "No assets found in " << assetDir.string() << endl;
+        return 1;
+    }
+    sort(files.begin(), files.end());
+
+    vector<PackItem> items;
+    for (const auto &file : files)
+    {
+        PackItem item = {};
+        string name = (assetDir.filename() / filesystem::relative(file, assetDir)).generic_string();
+        if (name.size() >= PACK_NAME_LENGTH)
+        {
+            cerr << "Name too long for the pack: " << name << endl;
+            return 1;
+        }
+        strcpy(item.entry.name, name.c_str());
+
+        string extension = file.extension().string();
+        transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        bool packed = extension == ".png"   ? packImage(file.string(), item)
+                      : extension == ".wav" ? packSound(file.string(), item)
+                                            : packBlob(file.string(), item);
+        if (!packed)
+            return 1;
+        items.push_back(move(item));
+    }
+
+    // Header, entry table, then every payload on its own aligned offset.
+    uint64_t offset = sizeof(PackHeader) + items.size() * sizeof(PackEntry);
+    for (auto &item : items)
+    {
+        offset = (offset + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+        item.entry.offset = offset;
+        item.entry.size = item.payload.size();
+        offset += item.payload.size();
+    }
+
+    ofstream out(output, ios::binary);
+    if (!out.is_open())
+    {
+        cerr << "Could not write " << output << endl;
+        return 1;
+    }
+    PackHeader header = {PACK_MAGIC, PACK_VERSION, (uint32_t)items.size(), 0};
+    out.write((const char *)&header, sizeof(header));
+    for (const auto &item : items)
+    {
+        out.write((const char *)&item.entry, sizeof(PackEntry));
+    }
+    const char padding[PACK_ALIGNMENT] = {};
+    for (const auto &item : items)
+    {
+        out.write(padding, item.entry.offset - (uint64_t)out.tellp());
+        out.write((const char *)item.payload.data(), item.payload.size());
+        const char *types[] = {"image", "sound", "blob"};
+        cout << "  " << item.entry.name << " (" << types[item.entry.type] << ", " << item.payload.size() << " bytes)" << endl;
+    }
+    cout << "Wrote " << items.size() << " assets, " << offset << " bytes, to " << output << endl;
+    return out.good() ? 0 : 1;
+}
@@ -0,0 +1,559 @@
+// ============================= SIMULATION ============================= //
+// Headless, tick-based gameplay rules shared by the game and the offline tools.
+// Nothing in here touches SDL, so the tools can run thousands of games without a window.
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <vector>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// ============================= DEFINITIONS ============================= //
+// Constants for screen size, car dimensions, and lane positions.
+// These values are used for scaling and positioning elements in the game.
+#define SCREEN_WIDTH 405
+#define SCREEN_HEIGHT 720
+#define CAR_WIDTH SCREEN_WIDTH / 10
+#define CAR_HEIGHT SCREEN_HEIGHT / 11
+#define LANE_WIDTH (SCREEN_WIDTH / 4)
+#define LANE_1 (LANE_WIDTH / 2 - CAR_WIDTH / 2)
+#define LANE_2 (LANE_WIDTH + LANE_WIDTH / 2 - CAR_WIDTH / 2)
+#define LANE_3 (2 * LANE_WIDTH + LANE_WIDTH / 2 - CAR_WIDTH / 2)
+#define LANE_4 (3 * LANE_WIDTH + LANE_WIDTH / 2 - CAR_WIDTH / 2)
+#define OBSTACLE_SIZE SCREEN_WIDTH / 10
+
+// The simulation advances one tick per rendered frame.
+#define TICKS_PER_SECOND 60
+#define CAR_Y (SCREEN_HEIGHT - 100)
+#define CAR_MOVE_TICKS 12     // ~200 ms lane change
+#define CAR_ROTATION_TICKS 12 // ~200 ms tilt
+#define CAR_MAX_TILT 15       // degrees at the peak of the tilt
+
+// ============================= OBSTACLE TYPES ============================= //
+enum ObstacleKind
+{
+    RED_BOX,
+    RED_CIRCLE,
+    BLUE_BOX,
+    BLUE_CIRCLE
+};
+
+// Plain rectangle so the simulation does not depend on SDL_Rect.
+struct SimRect
+{
+    int x, y, w, h;
+};
+
+// Same semantics as SDL_HasIntersection: empty rectangles never intersect.
+inline bool simIntersects(const SimRect &a, const SimRect &b)
+{
+    if (a.w <= 0 || a.h <= 0 || b.w <= 0 || b.h <= 0)
+        return false;
+    return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+struct Obstacle
+{
+    int id;
+    ObstacleKind kind;
+    SimRect rect;
+    bool collected;
+
+    bool isBox() const { return kind == RED_BOX || kind == BLUE_BOX; }
+    bool isRed() const { return kind == RED_BOX || kind == RED_CIRCLE; }
+};
+
+// ============================= CAR ============================= //
+// A player's car that toggles between its two lanes with a short slide and tilt.
+struct SimCar
+{
+    SimRect rect;
+    int laneA, laneB;
+    double angle = 0;
+    bool rotating = false;
+    int rotationStartTick = 0;
+    bool moving = false;
+    int targetX = 0;
+    int moveStartTick = 0;
+
+    void reset(int startLane, int otherLane)
+    {
+        laneA = startLane;
+        laneB = otherLane;
+        rect = {startLane, CAR_Y, CAR_WIDTH, CAR_HEIGHT};
+        angle = 0;
+        rotating = false;
+        moving = false;
+        targetX = startLane;
+    }
+
+    // Switches to the other lane; mid-move presses head back to the first lane, as before.
+    void steer(int tick)
+    {
+        targetX = (rect.x == laneA) ? laneB : laneA;
+        moving = true;
+        moveStartTick = tick;
+        rotating = true;
+        rotationStartTick = tick;
+    }
+
+    // Uses a sine wave to calculate the angle the car should rotate while moving.
+    void updateRotation(int tick)
+    {
+        if (rotating)
+        {
+            int elapsed = tick - rotationStartTick;
+            if (elapsed < CAR_ROTATION_TICKS)
+            {
+                angle = CAR_MAX_TILT * sin((M_PI / CAR_ROTATION_TICKS) * elapsed);
+            }
+            else
+            {
+                angle = 0;
+                rotating = false;
+            }
+        }
+    }
+
+    // Make the car go smoothly when changing lanes.
+    void updateMovement(int tick)
+    {
+        if (moving)
+        {
+            int elapsed = tick - moveStartTick;
+            if (elapsed < CAR_MOVE_TICKS)
+            {
+                double t = (double)elapsed / CAR_MOVE_TICKS;
+                rect.x = rect.x + t * (targetX - rect.x);
+            }
+            else
+            {
+                rect.x = targetX;
+                moving = false;
+            }
+        }
+    }
+};
+
+// ============================= DIFFICULTY ============================= //
+// Spawn-rate and obstacle-speed schedule. Every stepInterval ticks (starting at tick 0)
+// the spawn interval shrinks and the obstacles speed up until they hit their limits.
+struct DifficultyParams
+{
+    int spawnRate = 80;
+    int spawnRateStep = 20;
+    int minSpawnRate = 20;
+    int obstacleSpeed = 6;
+    int speedStep = 2;
+    int maxObstacleSpeed = 15;
+    int stepInterval = 30 * TICKS_PER_SECOND;
+};
+
+// What happened during the last tick, so the caller can play sounds and spawn effects.
+// The first few obstacles hit are kept with where they were hit.
+#define SIM_MAX_HITS 4
+
+struct SimEvents
+{
+    int pickups = 0;
+    int crashes = 0;
+    int misses = 0;
+    int hitCount = 0;
+    Obstacle hits[SIM_MAX_HITS];
+};
+
+// ============================= SIMULATION CLASS ============================= //
+class Simulation
+{
+public:
+    DifficultyParams params;
+    std::vector<Obstacle> obstacles;
+    SimCar blueCar, redCar;
+    unsigned seed = 0;
+    int tick = 0;
+    int score = 0;
+    int spawnRate = 80;
+    int obstacleSpeed = 6;
+    bool dead = false;
+    SimEvents events;
+
+    void reset(unsigned runSeed)
+    {
+        seed = runSeed;
+        rng.seed(seed);
+        obstacles.clear();
+        blueCar.reset(LANE_1, LANE_2);
+        redCar.reset(LANE_4, LANE_3);
+        tick = 0;
+        score = 0;
+        spawnRate = params.spawnRate;
+        obstacleSpeed = params.obstacleSpeed;
+        patternTimer = 0;
+        nextObstacleId = 0;
+        dead = false;
+        events = SimEvents();
+    }
+
+    void steerBlue() { blueCar.steer(tick); }
+    void steerRed() { redCar.steer(tick); }
+
+    // Advances the game by one frame, in the same order the game loop always used.
+    void step()
+    {
+        events = SimEvents();
+        updateObstacles();
+        checkCollision();
+        increaseDifficulty();
+        spawnObstacle();
+        blueCar.updateRotation(tick);
+        blueCar.updateMovement(tick);
+        redCar.updateRotation(tick);
+        redCar.updateMovement(tick);
+        tick++;
+    }
+
+private:
+    std::mt19937 rng;
+    int patternTimer = 0;
+    int nextObstacleId = 0;
+
+    // Spawns a pair of obstacles in random lanes, never two boxes for the same car.
+    void spawnObstacle()
+    {
+        if (patternTimer == 0)
+        {
+            int lanes[4] = {0, 1, 2, 3};
+            std::shuffle(lanes, lanes + 4, rng);
+
+            bool redBoxSpawned = false;
+            bool blueBoxSpawned = false;
+            bool redCircleSpawned = false;
+            bool blueCircleSpawned = false;
+
+            for (int i = 0; i < 2; ++i)
+            {
+                Obstacle obstacle;
+                bool chosen = true;
+                if (lanes[i] == 0 || lanes[i] == 1)
+                {
+                    if (!redBoxSpawned && rng() % 2 == 0)
+                    {
+                        obstacle.kind = RED_BOX;
+                        redBoxSpawned = true;
+                    }
+                    else if (!redCircleSpawned)
+                    {
+                        obstacle.kind = RED_CIRCLE;
+                        redCircleSpawned = true;
+                    }
+                    else
+                    {
+                        chosen = false;
+                    }
+                    obstacle.rect.x = (lanes[i] == 0) ? LANE_3 : LANE_4;
+                }
+                else
+                {
+                    if (!blueBoxSpawned && rng() % 2 == 0)
+                    {
+                        obstacle.kind = BLUE_BOX;
+                        blueBoxSpawned = true;
+                    }
+                    else if (!blueCircleSpawned)
+                    {
+                        obstacle.kind = BLUE_CIRCLE;
+                        blueCircleSpawned = true;
+                    }
+                    else
+                    {
+                        chosen = false;
+                    }
+                    obstacle.rect.x = (lanes[i] == 2) ? LANE_1 : LANE_2;
+                }
+                // A circle followed by a coin-flip box on the same side used to produce an
+                // obstacle with no texture at all; it was invisible and harmless, so skip it.
+                if (!chosen)
+                    continue;
+
+                obstacle.id = nextObstacleId++;
+                obstacle.collected = false;
+                obstacle.rect.w = OBSTACLE_SIZE;
+                obstacle.rect.h = OBSTACLE_SIZE;
+                obstacle.rect.y = -obstacle.rect.h;
+
+                if (!obstacles.empty())
+                {
+                    const Obstacle &lastObstacle = obstacles.back();
+                    if (lastObstacle.rect.y < CAR_HEIGHT + 10)
+                    {
+                        obstacle.rect.y = lastObstacle.rect.y - (CAR_HEIGHT + 10);
+                    }
+                }
+                obstacles.push_back(obstacle);
+            }
+            patternTimer = spawnRate;
+        }
+        else
+        {
+            patternTimer--;
+        }
+    }
+
+    // Moves obstacles downward and removes off-screen ones; a missed circle ends the run.
+    void updateObstacles()
+    {
+        for (auto &obstacle : obstacles)
+        {
+            obstacle.rect.y += obstacleSpeed;
+        }
+        obstacles.erase(std::remove_if(obstacles.begin(), obstacles.end(), [this](const Obstacle &o)
+                                       {
+                                           if (o.rect.y > SCREEN_HEIGHT)
+                                           {
+                                               if (!o.isBox() && !o.collected)
+                                               {
+                                                   events.misses++;
+                                                   dead = true;
+                                               }
+                                               return true;
+                                           }
+                                           return false; }),
+                        obstacles.end());
+    }
+
+    // Cars collect circles of their colour and crash into boxes of their colour.
+    void checkCollision()
+    {
+        for (auto &obstacle : obstacles)
+        {
+            SimCar &car = obstacle.isRed() ? redCar : blueCar;
+            if (simIntersects(car.rect, obstacle.rect))
+            {
+                if (events.hitCount < SIM_MAX_HITS && (obstacle.isBox() || !obstacle.collected))
+                    events.hits[events.hitCount++] = obstacle;
+                if (obstacle.isBox())
+                {
+                    events.crashes++;
+                    dead = true;
+                }
+                else if (!obstacle.collected)
+                {
+                    score++;
+                    obstacle.collected = true;
+                    events.pickups++;
+                }
+            }
+        }
+        obstacles.erase(std::remove_if(obstacles.begin(), obstacles.end(), [](const Obstacle &o)
+                                       { return o.collected; }),
+                        obstacles.end());
+    }
+
+    void increaseDifficulty()
+    {
+        if (tick % params.stepInterval == 0)
+        {
+            if (spawnRate > params.minSpawnRate)
+                spawnRate -= params.spawnRateStep;
+            if (obstacleSpeed < params.maxObstacleSpeed)
+                obstacleSpeed += params.speedStep;
+        }
+    }
+};
+
+// ============================= BOT ============================= //
+// How good a bot player is: how long it takes to react and how often it gets things wrong.
+struct BotSkill
+{
+    int reactionTicks = 15;
+    double errorRate = 0.01;
+};
+
+// Steers one car towards circles and away from boxes of its colour. Every obstacle is judged
+// once, as soon as it appears on screen, and the steer is carried out reactionTicks later (and
+// never before the previous obstacle has passed the car). With probability errorRate the bot
+// misjudges an obstacle and does nothing about it.
+class Bot
+{
+public:
+    void reset(const SimCar &car, const BotSkill &botSkill)
+    {
+        skill = botSkill;
+        plannedX = car.rect.x;
+        lastDecidedId = -1;
+        pending.clear();
+    }
+
+    // Returns true when the car should be steered this tick.
+    bool think(const Simulation &sim, const SimCar &car, bool red, std::mt19937 &rng)
+    {
+        if (pending.empty())
+            plannedX = car.targetX;
+
+        // Obstacles are stored in spawn order, which is also the order they reach the car.
+        for (const auto &obstacle : sim.obstacles)
+        {
+            if (obstacle.isRed() != red || obstacle.id <= lastDecidedId)
+                continue;
+            if (obstacle.rect.y + obstacle.rect.h <= 0)
+                break;
+
+            int previousId = lastDecidedId;
+            lastDecidedId = obstacle.id;
+            bool inLane = obstacle.rect.x == plannedX;
+            bool wantMove = obstacle.isBox() ? inLane : !inLane;
+            std::uniform_real_distribution<double> roll(0.0, 1.0);
+            if (wantMove && roll(rng) >= skill.errorRate)
+            {
+                pending.push_back({sim.tick + skill.reactionTicks, previousId});
+                plannedX = (plannedX == car.laneA) ? car.laneB : car.laneA;
+            }
+        }
+
+        if (!pending.empty() && pending.front().readyTick <= sim.tick && hasPassed(sim, car, pending.front().afterId))
+        {
+            pending.erase(pending.begin());
+            return true;
+        }
+        return false;
+    }
+
+private:
+    struct PlannedSteer
+    {
+        int readyTick;
+        int afterId;
+    };
+
+    BotSkill skill;
+    int plannedX = 0;
+    int lastDecidedId = -1;
+    std::vector<PlannedSteer> pending;
+
+    // An obstacle is out of the way once it is gone or entirely below the car.
+    static bool hasPassed(const Simulation &sim, const SimCar &car, int id)
+    {
+        for (const auto &obstacle : sim.obstacles)
+        {
+            if (obstacle.id == id)
+                return obstacle.rect.y > car.rect.y + car.rect.h;
+        }
+        return true;
+    }
+};
+
+// ============================= SESSIONS ============================= //
+// A recorded run: the seed, the difficulty schedule and every steer with the tick it happened
+// on. The simulation is deterministic, so this is enough to replay the run exactly.
+struct SessionSteer
+{
+    int tick;
+    bool red;
+};
+
+struct Session
+{
+    unsigned seed = 0;
+    DifficultyParams params;
+    std::vector<SessionSteer> steers;
+    int ticks = 0;
+
+    void begin(const Simulation &sim)
+    {
+        seed = sim.seed;
+        params = sim.params;
+        steers.clear();
+        ticks = 0;
+    }
+
+    bool save(const std::string &path) const
+    {
+        std::ofstream file(path);
+        if (!file.is_open())
+            return false;
+        file << "twocars-session 1\n";
+        file << "seed " << seed << "\n";
+        file << "params " << params.spawnRate << " " << params.spawnRateStep << " " << params.minSpawnRate << " "
+             << params.obstacleSpeed << " " << params.speedStep << " " << params.maxObstacleSpeed << " "
+             << params.stepInterval << "\n";
+        for (const auto &steer : steers)
+            file << "steer " << steer.tick << " " << (steer.red ? "red" : "blue") << "\n";
+        file << "end " << ticks << "\n";
+        return file.good();
+    }
+
+    bool load(const std::string &path)
+    {
+        std::ifstream file(path);
+        std::string word;
+        int version = 0;
+        if (!(file >> word >> version) || word != "twocars-session" || version != 1)
+            return false;
+        steers.clear();
+        ticks = 0;
+        while (file >> word)
+        {
+            if (word == "seed")
+                file >> seed;
+            else if (word == "params")
+                file >> params.spawnRate >> params.spawnRateStep >> params.minSpawnRate >> params.obstacleSpeed >>
+                    params.speedStep >> params.maxObstacleSpeed >> params.stepInterval;
+            else if (word == "steer")
+            {
+                SessionSteer steer;
+                std::string car;
+                file >> steer.tick >> car;
+                steer.red = car == "red";
+                steers.push_back(steer);
+            }
+            else if (word == "end")
+                file >> ticks;
+            else
+                return false;
+        }
+        return ticks > 0 && params.stepInterval > 0;
+    }
+};
+
+// Steps a simulation through a recorded session, applying each steer on its tick.
+class SessionPlayer
+{
+public:
+    void start(const Session &recorded, Simulation &simulation)
+    {
+        session = &recorded;
+        sim = &simulation;
+        sim->params = session->params;
+        sim->reset(session->seed);
+        nextSteer = 0;
+    }
+
+    bool finished() const { return sim->tick >= session->ticks || sim->dead; }
+
+    void step()
+    {
+        while (nextSteer < session->steers.size() && session->steers[nextSteer].tick <= sim->tick)
+        {
+            if (session->steers[nextSteer].red)
+                sim->steerRed();
+            else
+                sim->steerBlue();
+            nextSteer++;
+        }
+        sim->step();
+    }
+
+private:
+    const Session *session = nullptr;
+    Simulation *sim = nullptr;
+    size_t nextSteer = 0;
+};
+
+#endif
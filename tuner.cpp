@@ -0,0 +1,274 @@
+// ============================= DIFFICULTY TUNER ============================= //
+// Monte-Carlo difficulty tuner. Plays large numbers of headless games with a
+// skill-limited bot on every core, prints survival-time and score distributions for a
+// difficulty schedule, and searches for the schedule whose median session length hits a target.
+//
+// Usage: tuner [options]
+//   --games N             games per candidate (default 20000)
+//   --threads N           worker threads (default: all cores)
+//   --seed N              base seed; results are reproducible for a given seed
+//   --reaction MS         bot reaction delay in milliseconds (default 250)
+//   --error-rate P        chance the bot misjudges an obstacle (default 0.01)
+//   --max-minutes M       cap on a single game's length (default 30)
+//   --target-median S     fit a schedule whose median survival is S seconds
+//   --spawn-rate N        initial frames between obstacle pairs (default 80)
+//   --spawn-rate-step N   spawn-rate decrease per difficulty step (default 20)
+//   --min-spawn-rate N    spawn-rate floor (default 20)
+//   --speed N             initial obstacle speed in pixels per frame (default 6)
+//   --speed-step N        speed increase per difficulty step (default 2)
+//   --max-speed N         speed ceiling (default 15)
+//   --step-seconds N      seconds between difficulty steps (default 30)
+#include "simulation.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+// ============================= TUNER SETTINGS ============================= //
+struct TunerOptions
+{
+    int games = 20000;
+    int threads = 0;
+    unsigned seed = 1;
+    int maxTicks = 30 * 60 * TICKS_PER_SECOND;
+    double targetMedian = 0;
+    BotSkill skill;
+    DifficultyParams params;
+};
+
+struct GameResult
+{
+    int ticks;
+    int score;
+};
+
+// Plays one full game and reports how long the bot survived.
+GameResult playGame(const DifficultyParams &params, const BotSkill &skill, unsigned seed, int maxTicks)
+{
+    Simulation sim;
+    sim.params = params;
+    sim.reset(seed);
+    mt19937 botRng(seed ^ 0x9E3779B9u);
+    Bot blueBot, redBot;
+    blueBot.reset(sim.blueCar, skill);
+    redBot.reset(sim.redCar, skill);
+
+    while (!sim.dead && sim.tick < maxTicks)
+    {
+        if (blueBot.think(sim, sim.blueCar, false, botRng))
+            sim.steerBlue();
+        if (redBot.think(sim, sim.redCar, true, botRng))
+            sim.steerRed();
+        sim.step();
+    }
+    return {sim.tick, sim.score};
+}
+
+// ============================= PARALLEL RUNS ============================= //
+// Spreads the games over worker threads. Game i always uses seed + i, so the
+// results do not depend on the thread count.
+vector<GameResult> runGames(const TunerOptions &options, const DifficultyParams &params, int games)
+{
+    vector<GameResult> results(games);
+    atomic<int> nextGame(0);
+    int threadCount = options.threads > 0 ? options.threads : (int)thread::hardware_concurrency();
+    if (threadCount < 1)
+        threadCount = 1;
+
+    vector<thread> workers;
+    for (int t = 0; t < threadCount; ++t)
+    {
+        workers.emplace_back([&]()
+                             {
+                                 for (int i = nextGame.fetch_add(1); i < games; i = nextGame.fetch_add(1))
+                                 {
+                                     results[i] = playGame(params, options.skill, options.seed + i, options.maxTicks);
+                                 } });
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    return results;
+}
+
+// ============================= STATISTICS ============================= //
+double percentile(vector<double> values, double p)
+{
+    if (values.empty())
+        return 0;
+    sort(values.begin(), values.end());
+    size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+double medianSurvival(const vector<GameResult> &results)
+{
+    vector<double> seconds;
+    for (const auto &result : results)
+        seconds.push_back((double)result.ticks / TICKS_PER_SECOND);
+    return percentile(seconds, 0.5);
+}
+
+void printDistribution(const char *name, const vector<double> &values, double bucketSize)
+{
+    double sum = 0, maxValue = 0;
+    for (double value : values)
+    {
+        sum += value;
+        maxValue = max(maxValue, value);
+    }
+    cout << name << ": mean " << fixed << setprecision(1) << sum / values.size()
+         << "  p10 " << percentile(values, 0.1)
+         << "  p25 " << percentile(values, 0.25)
+         << "  p50 " << percentile(values, 0.5)
+         << "  p75 " << percentile(values, 0.75)
+         << "  p90 " << percentile(values, 0.9)
+         << "  p99 " << percentile(values, 0.99) << "\n";
+
+    int buckets = (int)(maxValue / bucketSize) + 1;
+    if (buckets > 20)
+    {
+        bucketSize = maxValue / 20 + 1e-9;
+        buckets = 20;
+    }
+    vector<int> histogram(buckets, 0);
+    for (double value : values)
+        histogram[min(buckets - 1, (int)(value / bucketSize))]++;
+    int peak = *max_element(histogram.begin(), histogram.end());
+    for (int i = 0; i < buckets; ++i)
+    {
+        cout << "  " << setw(7) << setprecision(1) << i * bucketSize << " - " << setw(7) << (i + 1) * bucketSize
+             << " | " << string(peak > 0 ? histogram[i] * 50 / peak : 0, '#') << " " << histogram[i] << "\n";
+    }
+}
+
+void printReport(const TunerOptions &options, const DifficultyParams &params, const vector<GameResult> &results)
+{
+    vector<double> seconds, scores;
+    int capped = 0;
+    for (const auto &result : results)
+    {
+        seconds.push_back((double)result.ticks / TICKS_PER_SECOND);
+        scores.push_back(result.score);
+        if (result.ticks >= options.maxTicks)
+            capped++;
+    }
+    cout << "spawnRate " << params.spawnRate << " (-" << params.spawnRateStep << ", min " << params.minSpawnRate << ")"
+         << "  obstacleSpeed " << params.obstacleSpeed << " (+" << params.speedStep << ", max " << params.maxObstacleSpeed << ")"
+         << "  step every " << params.stepInterval / TICKS_PER_SECOND << " s\n";
+    cout << results.size() << " games, " << capped << " hit the " << options.maxTicks / TICKS_PER_SECOND << " s cap\n";
+    printDistribution("survival (s)", seconds, 10);
+    printDistribution("score", scores, 10);
+}
+
+// ============================= FITTING ============================= //
+// Screens a grid of starting spawn rates and speeds with a small sample, then re-runs the
+// closest candidates at full size and keeps the one whose median is nearest the target.
+DifficultyParams fitSchedule(const TunerOptions &options)
+{
+    struct Candidate
+    {
+        DifficultyParams params;
+        double error;
+    };
+    vector<Candidate> candidates;
+    int screeningGames = max(200, options.games / 20);
+    for (int spawnRate = 40; spawnRate <= 140; spawnRate += 10)
+    {
+        for (int speed = 3; speed <= 12; ++speed)
+        {
+            DifficultyParams params = options.params;
+            params.spawnRate = spawnRate;
+            params.obstacleSpeed = speed;
+            double median = medianSurvival(runGames(options, params, screeningGames));
+            candidates.push_back({params, fabs(median - options.targetMedian)});
+        }
+    }
+    sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b)
+         { return a.error < b.error; });
+
+    Candidate best = candidates[0];
+    best.error = 1e9;
+    for (size_t i = 0; i < candidates.size() && i < 5; ++i)
+    {
+        double median = medianSurvival(runGames(options, candidates[i].params, options.games));
+        double error = fabs(median - options.targetMedian);
+        cout << "  candidate spawnRate " << candidates[i].params.spawnRate << " speed " << candidates[i].params.obstacleSpeed
+             << " -> median " << fixed << setprecision(1) << median << " s\n";
+        if (error < best.error)
+            best = {candidates[i].params, error};
+    }
+    return best.params;
+}
+
+// ============================= MAIN ============================= //
+int main(int argc, char *argv[])
+{
+    TunerOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            cerr << "Missing value for " << arg << endl;
+            return 1;
+        }
+        const char *value = argv[++i];
+        if (arg == "--games")
+            options.games = atoi(value);
+        else if (arg == "--threads")
+            options.threads = atoi(value);
+        else if (arg == "--seed")
+            options.seed = (unsigned)strtoul(value, nullptr, 10);
+        else if (arg == "--reaction")
+            options.skill.reactionTicks = atoi(value) * TICKS_PER_SECOND / 1000;
+        else if (arg == "--error-rate")
+            options.skill.errorRate = atof(value);
+        else if (arg == "--max-minutes")
+            options.maxTicks = atoi(value) * 60 * TICKS_PER_SECOND;
+        else if (arg == "--target-median")
+            options.targetMedian = atof(value);
+        else if (arg == "--spawn-rate")
+            options.params.spawnRate = atoi(value);
+        else if (arg == "--spawn-rate-step")
+            options.params.spawnRateStep = atoi(value);
+        else if (arg == "--min-spawn-rate")
+            options.params.minSpawnRate = atoi(value);
+        else if (arg == "--speed")
+            options.params.obstacleSpeed = atoi(value);
+        else if (arg == "--speed-step")
+            options.params.speedStep = atoi(value);
+        else if (arg == "--max-speed")
+            options.params.maxObstacleSpeed = atoi(value);
+        else if (arg == "--step-seconds")
+            options.params.stepInterval = atoi(value) * TICKS_PER_SECOND;
+        else
+        {
+            cerr << "Unknown option " << arg << endl;
+            return 1;
+        }
+    }
+    if (options.games < 1 || options.params.stepInterval < 1)
+    {
+        cerr << "--games and --step-seconds must be positive" << endl;
+        return 1;
+    }
+
+    printReport(options, options.params, runGames(options, options.params, options.games));
+
+    if (options.targetMedian > 0)
+    {
+        cout << "\nFitting a schedule for a median session of " << options.targetMedian << " s\n";
+        DifficultyParams fitted = fitSchedule(options);
+        cout << "\nFitted schedule:\n";
+        printReport(options, fitted, runGames(options, fitted, options.games));
+    }
+    return 0;
+}